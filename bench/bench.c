@@ -0,0 +1,234 @@
+// Hammering-webserver suite
+//
+// Benchmark.
+// Runs every file in the corpus through the grammars that fit it,
+// for every backend that accepts the grammar, and reports:
+//   requests/s, ns/byte, p50 and p99 latency, arena bytes per parse.
+//
+// Usage: bbench [-n iterations] corpus-dir
+// Built with PROFILE=1 it ends with the rule profile (profile.h), and
+// writes the folded stacks to rules.folded.
+// File names say what's in them:
+//   *.json            JSON document
+//   response-*        HTTP response
+//   anything else     HTTP request (malicious-* ones are expected to fail)
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "parser-helpers.h"
+#include "http.h"
+#include "json.h"
+#include "backend.h"
+#include "message.h"
+#include "profile.h"
+
+#define DEFAULT_ITERATIONS 100
+
+typedef enum {
+  KIND_REQUEST,
+  KIND_RESPONSE,
+  KIND_JSON,
+} kind_t;
+
+// A grammar to run a kind of input through
+typedef struct {
+  const char *name;
+  kind_t kind;
+  HParser *(*parser)(void);
+  int framed;   // run through parse_message() instead of h_parse
+} grammar_t;
+
+static HParser *request_p(void)  { return END(generic_http_request()); }
+static HParser *head_p(void)     { return h_sequence(any_request_head(), NULL); }
+static HParser *response_p(void) { return END(http_response()); }
+static HParser *json_p(void)     { return END(json); }
+
+static const grammar_t grammars[] = {
+  { "generic_http_request", KIND_REQUEST,  request_p,  0 },
+  { "parse_message",        KIND_REQUEST,  head_p,     1 },
+  { "http_response",        KIND_RESPONSE, response_p, 0 },
+  { "json",                 KIND_JSON,     json_p,     0 },
+};
+#define GRAMMARS_LEN (sizeof(grammars) / sizeof(grammars[0]))
+
+
+static kind_t kind_of(const char *name) {
+  size_t len = strlen(name);
+  if (len > 5 && 0 == strcmp(name + len - 5, ".json")) {
+    return KIND_JSON;
+  }
+  if (0 == strncmp(name, "response-", 9)) {
+    return KIND_RESPONSE;
+  }
+  return KIND_REQUEST;
+}
+
+
+static uint8_t *read_file(const char *path, size_t *len) {
+  FILE *f = fopen(path, "rb");
+  if (NULL == f) {
+    return NULL;
+  }
+  fseek(f, 0, SEEK_END);
+  *len = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  uint8_t *buf = malloc(*len ? *len : 1);
+  if (NULL != buf && *len != fread(buf, 1, *len, f)) {
+    free(buf);
+    buf = NULL;
+  }
+  fclose(f);
+  return buf;
+}
+
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+
+/* Parse input once.
+ * Returns whether it parsed, adds the arena bytes used.
+ */
+static int parse_once(const grammar_t *g, HParser *p, const uint8_t *input, size_t len, size_t *arena_bytes) {
+  HArenaStats stats;
+  if (g->framed) {
+    message_t msg;
+    message_status_t status = parse_message(p, NULL, DEFAULT_MAX_BODY, input, len, &msg);
+    if (NULL != msg.head_result) {
+      h_allocator_stats(msg.head_result->arena, &stats);
+      *arena_bytes += stats.used + stats.wasted;
+    }
+    message_free(&msg);
+    return MSG_OK == status;
+  }
+  HParseResult *res = http_parse(p, input, len);
+  if (NULL == res) {
+    return 0;
+  }
+  h_allocator_stats(res->arena, &stats);
+  *arena_bytes += stats.used + stats.wasted;
+  h_parse_result_free(res);
+  return 1;
+}
+
+
+static void bench(const char *file, const grammar_t *g, HParserBackend backend,
+		  const uint8_t *input, size_t len, size_t iterations) {
+  HParser *p = g->parser();
+  if (!compile_for(p, backend)) {
+    return; // grammar doesn't fit this backend
+  }
+
+  uint64_t *samples = malloc(iterations * sizeof(uint64_t));
+  size_t arena_bytes = 0;
+  int ok = 1;
+  uint64_t total = 0;
+  for (size_t i = 0; i < iterations; i++) {
+    uint64_t start = now_ns();
+    ok = parse_once(g, p, input, len, &arena_bytes);
+    samples[i] = now_ns() - start;
+    total += samples[i];
+  }
+  qsort(samples, iterations, sizeof(uint64_t), cmp_u64);
+
+  printf("%-34s %-22s %-8s %-4s %12.0f %10.2f %10.1f %10.1f %12zu\n",
+	 file, g->name, backend_name(backend), ok ? "ok" : "fail",
+	 iterations * 1e9 / total,
+	 (double)total / iterations / (len ? len : 1),
+	 samples[iterations / 2] / 1e3,
+	 samples[iterations * 99 / 100] / 1e3,
+	 arena_bytes / iterations);
+  free(samples);
+}
+
+
+static int by_name(const struct dirent **a, const struct dirent **b) {
+  return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+static int not_hidden(const struct dirent *e) {
+  return '.' != e->d_name[0];
+}
+
+
+int main(int argc, char *argv[]) {
+  size_t iterations = DEFAULT_ITERATIONS;
+  int opt;
+  while (-1 != (opt = getopt(argc, argv, "n:"))) {
+    if ('n' == opt) {
+      iterations = strtoul(optarg, NULL, 10);
+    }
+  }
+  if (optind >= argc || 0 == iterations) {
+    fprintf(stderr, "usage: %s [-n iterations] corpus-dir\n", argv[0]);
+    return 1;
+  }
+  const char *dir = argv[optind];
+
+  init_json_parser();
+  init_http_parser();
+
+  struct dirent **entries;
+  int n = scandir(dir, &entries, not_hidden, by_name);
+  if (n < 0) {
+    perror(dir);
+    return 1;
+  }
+
+  printf("%-34s %-22s %-8s %-4s %12s %10s %10s %10s %12s\n",
+	 "input", "grammar", "backend", "", "req/s", "ns/byte", "p50 us", "p99 us", "arena/parse");
+  for (int i = 0; i < n; i++) {
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, entries[i]->d_name);
+    size_t len;
+    uint8_t *input = read_file(path, &len);
+    if (NULL == input) {
+      perror(path);
+      continue;
+    }
+    kind_t kind = kind_of(entries[i]->d_name);
+    for (size_t g = 0; g < GRAMMARS_LEN; g++) {
+      if (grammars[g].kind != kind) {
+	continue;
+      }
+      for (size_t b = 0; b < backend_preference_len; b++) {
+	bench(entries[i]->d_name, &grammars[g], backend_preference[b], input, len, iterations);
+      }
+    }
+    free(input);
+    free(entries[i]);
+  }
+  free(entries);
+
+#ifdef PROFILE_RULES
+  // what the rules cost over all of the above, and where
+  printf("\n");
+  profile_report(stdout);
+  FILE *folded = fopen("rules.folded", "w");
+  if (NULL == folded) {
+    perror("rules.folded");
+    return 1;
+  }
+  profile_folded(folded);
+  fclose(folded);
+  printf("\nfolded stacks in rules.folded: flamegraph.pl rules.folded > rules.svg\n");
+#endif
+  return 0;
+}
@@ -0,0 +1,37 @@
+// Hammering-webserver suite
+//
+// Backend selection for the parsers
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __BACKEND_H
+#define __BACKEND_H
+
+#include <stdio.h>
+
+// The backends we try, fastest first.
+// Packrat always works, it is the fallback.
+extern const HParserBackend backend_preference[];
+extern const size_t backend_preference_len;
+
+// Printable name of a backend
+const char *backend_name(HParserBackend backend);
+
+// Compile a parser for backend, with the parameters we use for it
+// (the k of LL(k)). Returns 1 when the backend accepts the grammar.
+int compile_for(HParser *parser, HParserBackend backend);
+
+// Compile a parser for the fastest backend that accepts it.
+// Returns the backend it got compiled for.
+HParserBackend compile_fastest(HParser *parser);
+
+// Compile the exported HTTP grammars (generic_http_request, http_response)
+// for their fastest backend. Call after init_http_parser().
+void compile_http_parser(void);
+
+// Print, for every rule in the http_rules registry,
+// which of the backends accept it.
+void backend_report(FILE *out);
+
+#endif
@@ -0,0 +1,53 @@
+// Hammering-webserver suite
+//
+// Transfer-Encoding: chunked
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __CHUNKED_H
+#define __CHUNKED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Default limits
+#define DEFAULT_MAX_CHUNK_LINE 4096  // a chunk-size line or trailer, without the CRLF
+#define DEFAULT_MAX_TRAILERS   32
+
+typedef enum {
+  CHUNKED_MORE,       // feed more
+  CHUNKED_DONE,       // the last chunk and the trailers are in
+  CHUNKED_REJECT,     // not chunked encoding, or the sink said no
+  CHUNKED_TOO_LARGE,  // payload or framing over max_body, or a line too long
+} chunked_status_t;
+
+// Gets the payload, a span of the input at a time, in order.
+// Return 0 to reject the body.
+typedef int (*chunk_sink_t)(void *user_data, const uint8_t *data, size_t len);
+
+// Where the decoder got to, so it can go on with the next piece
+typedef struct {
+  size_t max_body;      // payload bytes; framing bytes as many again, and max_line
+  size_t max_line;
+  size_t max_trailers;
+
+  chunked_status_t status;
+  int state;            // see chunked.c
+  size_t used;          // bytes of input that were the body, so far
+  size_t chunk_left;    // payload to go in this chunk
+  size_t payload;
+  size_t framing;
+  size_t line_len;
+  size_t trailers;
+} chunked_t;
+
+void chunked_init(chunked_t *ch, size_t max_body);
+
+// Decode the next piece, any size. The payload goes to sink (NULL to
+// skip over it) without being copied. At CHUNKED_DONE, ch->used bytes
+// of all input were the body; the rest is the next message.
+chunked_status_t chunked_feed(chunked_t *ch, const uint8_t *input, size_t length,
+			      chunk_sink_t sink, void *user_data);
+
+#endif
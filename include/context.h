@@ -0,0 +1,45 @@
+// Hammering-webserver suite
+//
+// Parse contexts: a reusable arena per connection
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __CONTEXT_H
+#define __CONTEXT_H
+
+// Default size of the region of a parse context, in bytes
+#define DEFAULT_CTX_SIZE (256 * 1024)
+
+// Memory that didn't fit in the region
+typedef struct ctx_overflow {
+  struct ctx_overflow *next;
+} ctx_overflow_t;
+
+// A bump allocator for hammer.
+// Give &ctx->allocator to the ..__m() functions. Everything they
+// allocate lives until parse_ctx_reset().
+typedef struct {
+  HAllocator allocator;     // must be first, hammer hands us this pointer
+  uint8_t *region;
+  size_t size;
+  size_t used;
+  size_t high_water;        // most bytes used between two resets, overflow included
+  size_t overflow_bytes;
+  ctx_overflow_t *overflow; // allocations that didn't fit in the region
+} parse_ctx_t;
+
+// Set up a context with a region of size bytes. Returns 0 when out of memory.
+int parse_ctx_init(parse_ctx_t *ctx, size_t size);
+
+// Forget everything allocated since the last reset.
+// All parse results from this context are gone after this.
+void parse_ctx_reset(parse_ctx_t *ctx);
+
+// Free the context
+void parse_ctx_free(parse_ctx_t *ctx);
+
+// Parse from the context, with spans like http_parse()
+HParseResult *ctx_parse(parse_ctx_t *ctx, const HParser *parser, const uint8_t *input, size_t length);
+
+#endif
@@ -0,0 +1,28 @@
+// Hammering-webserver suite
+//
+// DFAs of the regular rules, generated by tools/dfagen.c
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __DFA_H
+#define __DFA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Each matches its namesake in http.c at the start of input, and no
+// further than length. Returns 1 and the length of the longest match
+// in match_len when there is one, 0 when the rule fails.
+// They build no tokens: use them to find where things end, and the
+// combinators when you need the AST.
+int dfa_any_method(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_http_version(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_any_status_code(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_any_header_name(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_lws(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_reason_text(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_post_url_chars(const uint8_t *input, size_t length, size_t *match_len);
+int dfa_request_uri(const uint8_t *input, size_t length, size_t *match_len);
+
+#endif
@@ -0,0 +1,54 @@
+// Hammering-webserver suite
+//
+// Resource governor: limits on what one parse may cost
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __GOVERNOR_H
+#define __GOVERNOR_H
+
+// Default limits
+#define DEFAULT_MAX_HEADERS 100
+#define DEFAULT_MAX_TOKENS  100000             // JSON values and headers
+#define DEFAULT_MAX_ARENA   (16 * 1024 * 1024) // bytes, packrat tables included
+
+// JSON nesting isn't counted, the grammar has a depth: see json_bounded().
+// 0 for no limit on any of these.
+typedef struct {
+  size_t max_headers;
+  size_t max_line;     // bytes in a header line, name and value
+  size_t max_tokens;
+  size_t max_arena;
+} parse_limits_t;
+
+extern const parse_limits_t default_parse_limits;
+
+// Which limit stopped the last parse on this thread
+typedef enum {
+  LIMIT_NONE,
+  LIMIT_HEADERS,
+  LIMIT_LINE,
+  LIMIT_TOKENS,
+  LIMIT_ARENA,
+} parse_limit_t;
+
+// Parse p within limits (NULL for default_parse_limits).
+// Once a limit is crossed every gate fails, so the parse fails fast.
+// The limits hold for p only; other parsers on the thread run free.
+HParser *limited(const HParser *p, const parse_limits_t *limits);
+
+// Gates for the grammars: they count, and fail over the limits of the
+// running limited() parse. Outside of one they always pass.
+HParser *token_gate(void);                            // before a JSON value
+HParser *governed_header(const HParser *header_p);    // around a (name value) header
+
+// After a parse: did it hit a limit?
+parse_limit_t governor_exceeded(void);
+
+// For http_parse(): no limits until a limited() parser says so,
+// and none after the parse is done. governor_exceeded() stays.
+void governor_begin(void);
+void governor_end(void);
+
+#endif
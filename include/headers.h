@@ -0,0 +1,117 @@
+// Hammering-webserver suite
+//
+// Known header names
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __HEADERS_H
+#define __HEADERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  HDR_UNKNOWN = 0,
+
+  // Response headers (RFC 2616 section 6.2)
+  HDR_ACCEPT_RANGES = 1,
+  HDR_AGE,
+  HDR_ETAG,
+  HDR_LOCATION,
+  HDR_PROXY_AUTHENTICATE,
+  HDR_RETRY_AFTER,
+  HDR_VARY,
+  HDR_WWW_AUTHENTICATE,
+
+  // Entity headers (RFC 2616 section 7.1)
+  HDR_ALLOW,
+  HDR_CONTENT_ENCODING,
+  HDR_CONTENT_LANGUAGE,
+  HDR_CONTENT_LENGTH,
+  HDR_CONTENT_LOCATION,
+  HDR_CONTENT_MD5,
+  HDR_CONTENT_RANGE,
+  HDR_CONTENT_TYPE,
+  HDR_EXPIRES,
+  HDR_LAST_MODIFIED,
+
+  // General headers (RFC 2616 section 4.5)
+  HDR_CACHE_CONTROL,
+  HDR_CONNECTION,
+  HDR_DATE,
+  HDR_PRAGMA,
+  HDR_TRAILER,
+  HDR_TRANSFER_ENCODING,
+  HDR_UPGRADE,
+  HDR_VIA,
+  HDR_WARNING,
+
+  // Request headers (RFC 2616 section 5.3), and cookies
+  HDR_ACCEPT,
+  HDR_ACCEPT_CHARSET,
+  HDR_ACCEPT_ENCODING,
+  HDR_ACCEPT_LANGUAGE,
+  HDR_AUTHORIZATION,
+  HDR_EXPECT,
+  HDR_FROM,
+  HDR_HOST,
+  HDR_IF_MATCH,
+  HDR_IF_MODIFIED_SINCE,
+  HDR_IF_NONE_MATCH,
+  HDR_IF_RANGE,
+  HDR_IF_UNMODIFIED_SINCE,
+  HDR_MAX_FORWARDS,
+  HDR_PROXY_AUTHORIZATION,
+  HDR_RANGE,
+  HDR_REFERER,
+  HDR_TE,
+  HDR_USER_AGENT,
+  HDR_COOKIE,
+
+  HDR_KNOWN_MAX
+} header_id_t;
+
+// Names of the known headers, by id
+extern const char *const header_names[HDR_KNOWN_MAX];
+
+// Which known header is this name? Case-insensitive.
+// Returns HDR_UNKNOWN for anything else.
+header_id_t header_id(const uint8_t *name, size_t len);
+
+// Groups of headers
+int is_response_header(header_id_t id);
+int is_entity_header(header_id_t id);
+
+// Hash of a header name, case-insensitive
+uint32_t header_hash(const uint8_t *name, size_t len);
+
+
+//----------------------------------
+// Header index
+// Built while parsing the headers (see request_headers()), in the arena.
+
+// A header; more headers with the same name follow through next, in order
+typedef struct header_entry {
+  const HParsedToken *name;     // TT_BYTES
+  const HParsedToken *value;    // TT_BYTES
+  struct header_entry *next;
+} header_entry_t;
+
+typedef struct {
+  const HParsedToken *headers;            // the (name value) tuples, in order
+  header_entry_t *known[HDR_KNOWN_MAX];   // first of each known header
+  header_entry_t **other;                 // open addressing on header_hash()
+  size_t other_mask;                      // size of other - 1
+} header_index_t;
+
+// Index a sequence of (name value) tuples
+header_index_t *header_index_new(HArena *arena, const HParsedToken *headers);
+
+// Look up a known header; NULL when it is not there
+const header_entry_t *header_index_get(const header_index_t *index, header_id_t id);
+
+// Look up any header by name, case-insensitive; NULL when it is not there
+const header_entry_t *header_index_find(const header_index_t *index, const uint8_t *name, size_t len);
+
+#endif
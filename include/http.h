@@ -5,6 +5,7 @@
 // Copyright 2018, Guido Witmond <guido@witmond.nl>
 // Licensed under AGPL v3 or later. See LICENSE
 
+#include "governor.h"
 
 //----------------------------------
 // Trivials
@@ -41,6 +42,8 @@ HParser *named_header(uint8_t *name);
 HParser *general_header(void);
 HParser *response_header(void);
 HParser *entity_header(void);
+HParser *any_header(void);
+HParser *request_headers(void);
 HParser *message_body(void);
 HParser *http_response(void);
 HParser *headers(HParser *parser);
@@ -55,10 +58,20 @@ HParser *any_method(void);
 HParser *post_url_chars(void);
 HParser *request_line(HParser *method, HParser *url);
 HParser *any_request_line(void);
+// Split a request line, CRLF and all, as any_request_line() would,
+// with the DFAs of dfa.h. Returns 0 when it isn't one.
+int scan_request_line(const uint8_t *line, size_t len, HBytes *method, HBytes *uri);
 HParser *generic_http_request(void);
-HParser *post(uint8_t* url, HParser *header_p, HParser *body);
+HParser *any_request_head(void);
+HParser *post(uint8_t* url, HParser *header_p, HParser *body, const parse_limits_t *limits);
+HParser *post_head(uint8_t* url, HParser *header_p);
+HParser *routed_head(HParser *header_p);
+int post_url_valid(uint8_t *url);
 HParser *request_uri(void);
+HParser *parsed_uri(void);
 HParser *path(void);
+HParser *pchar(void);
+HParser *pct_encoded(void);
 
 
 //----------------------------------
@@ -67,9 +80,36 @@ HParser *http_version(void);
 HParser *reason_phrase(void);
 HParser *reason_text(void);
 HParser *status_line(HParser *status_code);
+// The same for status_line(any_status_code()), with the DFAs.
+int scan_status_line(const uint8_t *line, size_t len, HBytes *code);
 HParser *http_response(void); // TODO: rename to: any_http_response
 
 //----------------------------------
 // Helpers
 HParsedToken *sequence_to_bytes(const HParseResult *p, void *user_data);
 HParsedToken *token_to_bytes(HArena *arena, const HParsedToken *t, void *user_data);
+HParsedToken *act_span(const HParseResult *p, void *user_data);
+HParsedToken *act_header_value(const HParseResult *p, void *user_data);
+
+// Parse with zero-copy results: names, values, status codes and urls
+// point into input (not \0 terminated) unless folding changed them.
+HParseResult *http_parse(const HParser *parser, const uint8_t *input, size_t length);
+HParseResult *http_parse__m(HAllocator *mm__, const HParser *parser, const uint8_t *input, size_t length);
+
+// Inside an action: what its parser matched in the input of the running
+// http_parse(). NULL outside http_parse(), or for an empty match.
+const uint8_t *matched_span(const HParseResult *p, size_t *len);
+
+
+//----------------------------------
+// Registry of the parameterless rules above
+typedef struct {
+  const char *name;
+  HParser *(*rule)(void);
+} http_rule_t;
+
+extern const http_rule_t http_rules[];
+extern const size_t http_rules_len;
+
+// Initialiser
+void init_http_parser(void);
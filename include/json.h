@@ -8,31 +8,84 @@
 #ifndef __JSON_H
 #define __JSON_H
 
+// The parsers below are built once, by init_json_parser(), and never
+// change after; any number of threads may use them at the same time.
+
+// Objects and arrays nest this deep at most, see json_bounded()
+#define DEFAULT_JSON_DEPTH 64
+
 // Full general JSON parser
-HParser *json;
+extern HParser *json;
 
 // JSON general sub-structure parsers
-HParser *json_any_number;
-HParser *json_any_string;
-HParser *json_any_array;
-HParser *json_any_object;
+extern HParser *json_any_number;
+extern HParser *json_any_string;
+extern HParser *json_any_array;
+extern HParser *json_any_object;
 
 // sub grammer parsers
-HParser *lit_true;
-HParser *lit_false;
-HParser *lit_null;
+extern HParser *lit_true;
+extern HParser *lit_false;
+extern HParser *lit_null;
+
+extern HParser *ws;
+extern HParser *comma;
+extern HParser *json_char;
+extern HParser *any_name_value_pair;
+
+// What json_any_number returns: a TT_json_number_t token, its user
+// field points to one of these.
+typedef enum {
+  JSON_INT,      // integral and fits in an int64_t
+  JSON_DOUBLE,   // anything else, correctly rounded
+} json_number_kind_t;
+
+typedef struct {
+  json_number_kind_t kind;
+  union {
+    int64_t i;
+    double d;
+  };
+} json_number_t;
+
+// What lit_true, lit_false and lit_null return: a TT_json_literal_t
+// token, its user field points to one of these.
+typedef enum {
+  JSON_FALSE,
+  JSON_TRUE,
+  JSON_NULL,
+} json_literal_t;
+
+// Convert the text of a JSON number, as json_any_number matches it.
+// Returns 0 when s is not a JSON number.
+int json_decode_number(const uint8_t *s, size_t len, json_number_t *out);
+
+// Decode the escapes in the text between the quotes of a string that
+// json_any_string accepted. out needs len bytes; out == in is fine.
+// Returns the decoded length.
+size_t json_unescape(const uint8_t *in, size_t len, uint8_t *out);
+
+// A field of an object for json_object_schema()
+typedef enum {
+  JSON_OPTIONAL,
+  JSON_REQUIRED,
+} json_presence_t;
 
-HParser *ws;
-HParser *comma;
-HParser *json_char;
-HParser *any_name_value_pair;
+typedef struct {
+  const char *name;
+  const HParser *value_p;
+  json_presence_t presence;
+} json_field_t;
 
 // Specific parser generators
 HParser *json_name_value_pair(uint8_t* name, HParser* value_p);
 HParser *json_object(HParser *parser);
+HParser *json_object_schema(const json_field_t *fields, size_t n_fields);
+HParser *json_bounded(size_t max_depth);
 HParser *json_prefix();
 
-// Initialiser
+// Initialiser: builds the parsers above on the first call, from
+// whichever thread; later and concurrent calls wait for that one.
 void init_json_parser();
 
 #endif
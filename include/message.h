@@ -0,0 +1,86 @@
+// Hammering-webserver suite
+//
+// HTTP message framing
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __MESSAGE_H
+#define __MESSAGE_H
+
+#include "prescan.h"
+#include "chunked.h"
+
+// Default limit on the body size, in bytes
+#define DEFAULT_MAX_BODY (1024 * 1024)
+
+typedef enum {
+  MSG_OK,          // head and body parsed
+  MSG_INCOMPLETE,  // the body is not all there yet
+  MSG_REJECT,      // the head or body did not parse, or bad framing
+  MSG_TOO_LARGE,   // Content-Length or chunked body over the limit
+} message_status_t;
+
+// A parsed message
+typedef struct {
+  const HParsedToken *head;   // what the head parser returned
+  const uint8_t *body;        // the body, a span into the input; a chunked
+                              // body decoded, NULL when body_p took it in chunks
+  size_t body_len;
+  const HParsedToken *value;  // what the body parser returned, NULL without one
+  size_t consumed;            // bytes of input used: head + body
+  HParseResult *head_result;  // owns the head tokens
+  HParseResult *body_result;  // owns the body tokens
+  uint8_t *decoded;           // a chunked body put together
+  HAllocator *decoded_mm;
+} message_t;
+
+// What a pre-scan outcome means for the message
+message_status_t message_status_of(prescan_status_t status);
+
+// Find the value of a header in a parsed head, case-insensitive.
+// Returns NULL when it is not there.
+const HParsedToken *find_header(const HParsedToken *head, const uint8_t *name);
+
+// Parse a message: the head with head_p, the body by its Content-Length
+// or chunked Transfer-Encoding (see chunked.h).
+// body_p parses the body bytes, all of them, or NULL to take them as is.
+// A Content-Length over max_body is rejected before the body gets parsed.
+// Parses from the front of input only: any next message starts at
+// input + msg->consumed.
+message_status_t parse_message(const HParser *head_p, const HParser *body_p, size_t max_body,
+			       const uint8_t *input, size_t length, message_t *msg);
+
+// Same, allocating from mm__ (see parse_ctx_t), NULL for the system allocator.
+message_status_t parse_message__m(HAllocator *mm__, const HParser *head_p, const HParser *body_p, size_t max_body,
+				  const uint8_t *input, size_t length, message_t *msg);
+
+// Second half of parse_message(): frame and parse the body after a head
+// of head_len bytes, which is parsed into msg->head already.
+message_status_t parse_message_body(const HParser *body_p, size_t max_body,
+				    const uint8_t *input, size_t length, size_t head_len,
+				    message_t *msg);
+message_status_t parse_message_body__m(HAllocator *mm__, const HParser *body_p, size_t max_body,
+				       const uint8_t *input, size_t length, size_t head_len,
+				       message_t *msg);
+
+// Same, for input that grows between calls: a chunked body's framing
+// goes on from where framing got to, so every byte gets checked once.
+// chunked_init(framing, max_body) before the first call for a message.
+message_status_t resume_message_body__m(HAllocator *mm__, const HParser *body_p, size_t max_body,
+					const uint8_t *input, size_t length, size_t head_len,
+					chunked_t *framing, message_t *msg);
+
+// May the connection carry another request? No when a Connection
+// header says close.
+int message_keep_alive(const message_t *msg);
+
+// The input of a message with a parsed head moved from from to to
+// (a realloc): make the spans of the head follow.
+void message_rebase(message_t *msg, uintptr_t from, size_t len, uint8_t *to);
+
+// Free the parse results of a message.
+// Call it after every parse_message(), whatever it returned.
+void message_free(message_t *msg);
+
+#endif
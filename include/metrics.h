@@ -0,0 +1,89 @@
+// Hammering-webserver suite
+//
+// Metrics: parse latency, sizes and rejects, per entry point
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __METRICS_H
+#define __METRICS_H
+
+#include <hammer/hammer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "server.h"
+
+// What got parsed
+typedef enum {
+  ENTRY_HTTP_REQUEST,   // generic_http_request(), and server routes
+  ENTRY_POST,           // post() parsers, and POST routes of the server
+  ENTRY_HTTP_RESPONSE,  // http_response()
+  ENTRY_JSON,           // json, json_bounded(), JSON schemas
+  ENTRY_COUNT
+} metric_entry_t;
+
+// Which part of the grammar said no
+typedef enum {
+  REJECT_NONE,
+  REJECT_START_LINE,    // request or status line
+  REJECT_HEADER,
+  REJECT_BODY,
+  REJECT_JSON,
+  REJECT_LIMIT,         // pre-scan or governor limits, or max_body
+  REJECT_COUNT
+} metric_reject_t;
+
+// HDR-style: 16 linear buckets per power of two, so a bucket is at
+// most 1/16th of its values wide, from 0 up to 2^64.
+#define HIST_SUB_BITS 4
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+typedef struct {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t count;
+  uint64_t sum;
+} histogram_t;
+
+typedef struct {
+  histogram_t latency_ns;
+  histogram_t input_bytes;
+  histogram_t arena_bytes;      // accepted parses only
+  uint64_t rejects[REJECT_COUNT];
+} entry_metrics_t;
+
+// Nanoseconds on a monotonic clock
+uint64_t metrics_clock(void);
+
+// Count a parse on this thread: no locks, no atomic read-modify-write.
+// The arena bytes count only when reject is REJECT_NONE.
+void metrics_record(metric_entry_t entry, uint64_t latency_ns, size_t input_bytes,
+		    size_t arena_bytes, metric_reject_t reject);
+
+// http_parse__m(), counted under entry. A reject gets its reason from
+// the governor, or else from a scan of the start line: REJECT_START_LINE
+// when that is wrong, REJECT_HEADER for anything after it, the body
+// included. JSON entries reject as REJECT_JSON.
+HParseResult *metered_parse(metric_entry_t entry, const HParser *parser, const uint8_t *input, size_t length);
+HParseResult *metered_parse__m(HAllocator *mm__, metric_entry_t entry, const HParser *parser,
+			       const uint8_t *input, size_t length);
+
+// The counts of all threads for entry, added up. Threads go on
+// counting meanwhile, so the total may be a parse or so behind.
+void metrics_merge(metric_entry_t entry, entry_metrics_t *out);
+
+// The value at quantile q (0..1): the highest one in its bucket.
+// 0 for an empty histogram.
+uint64_t histogram_quantile(const histogram_t *h, double q);
+
+// All of it in the Prometheus text format (version 0.0.4): summaries
+// with quantiles 0.5, 0.9, 0.99 and 0.999, and counters of rejects.
+void metrics_export(FILE *out);
+
+// A handler for the server that answers with metrics_export(), e.g.
+//   { routed_head(any_header()), NULL, 0, metrics_handler, NULL, "GET", "/metrics" }
+void metrics_handler(const message_t *msg, response_t *res, void *user_data);
+
+// Forget all counts; threads that parse meanwhile may keep a few
+void metrics_reset(void);
+
+#endif
@@ -13,19 +13,39 @@
 
 // Parser Functions macro
 //   behave like H_RULE but return a function instead of a variable.
+//   The parser is built on the first call and cached; every later call
+//   returns the same (immutable, shared) parser.
 // Like this:
 //   PF_RULE(sp, h_ch(' '));
 // returns:
 //   HParser *sp() {
-//     return h_ch(' ');
+//     static HParser *sp_p = NULL;
+//     if (NULL == sp_p) sp_p = h_ch(' ');
+//     return sp_p;
 //   }
-#define PF_RULE(rule, def) HParser *rule() { return def; }
+// Call the init_..._parser() functions once at startup to build all of
+// them before any threads get to see them.
+#define PF_RULE(rule, def) HParser *rule() {		\
+    static HParser *rule##_p = NULL;			\
+    if (NULL == rule##_p) rule##_p = PROFILED(#rule, def); \
+    return rule##_p;					\
+  }
+
+// Named rules, as the rule profiler sees them. Build everything with
+// -DPROFILE_RULES (PROFILE=1 make) to count what each one costs;
+// see profile.h. Otherwise a rule is just its definition.
+#ifdef PROFILE_RULES
+#include "profile.h"
+#define PROFILED(name, def) profiled(name, def)
+#else
+#define PROFILED(name, def) (def)
+#endif
 
 
 // E.._RULE s define like the hammer-ones except the don't declare the variable.
 // Add one in the desires scope (i.e. file scope, header file, etc)
 // #define H_RULE(rule, def)  HParser *rule = def
-#define   EH_RULE(rule, def)           rule = def
+#define   EH_RULE(rule, def)           rule = PROFILED(#rule, def)
 
 
 // Get the parse input string lengths correct, all the time
@@ -0,0 +1,50 @@
+// Hammering-webserver suite
+//
+// Pre-scan of the head before the grammar runs
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __PRESCAN_H
+#define __PRESCAN_H
+
+// Default limits on the head
+#define DEFAULT_MAX_HEAD  8192  // bytes, up to and including the empty line
+#define DEFAULT_MAX_LINES 100   // request line and header lines
+#define DEFAULT_MAX_LINE  8190  // bytes in a line, without the CRLF
+
+typedef enum {
+  PRESCAN_COMPLETE,        // found the empty line, *head_len is set
+  PRESCAN_INCOMPLETE,      // no empty line yet
+  PRESCAN_BAD_BYTE,        // a byte no rule in the head allows
+  PRESCAN_BARE_CR,         // CR without LF
+  PRESCAN_BARE_LF,         // LF without CR
+  PRESCAN_TOO_MANY_LINES,
+  PRESCAN_LINE_TOO_LONG,
+  PRESCAN_HEAD_TOO_LARGE,
+} prescan_status_t;
+
+typedef struct {
+  size_t max_head;
+  size_t max_lines;
+  size_t max_line;
+} prescan_limits_t;
+
+extern const prescan_limits_t prescan_default_limits;
+
+// Where the scan got to, so it can go on when more input arrives
+typedef struct {
+  size_t pos;
+  size_t line_start;
+  size_t lines;
+} prescan_t;
+
+#define PRESCAN_INIT { 0, 0, 0 }
+
+// Scan input for the end of the head, from where the last call stopped.
+// Rejects what the grammar would reject anyway: bytes outside tab and
+// 32-126, a CR or LF on its own, and what goes over the limits.
+prescan_status_t prescan_head(prescan_t *scan, const uint8_t *input, size_t length,
+			      const prescan_limits_t *limits, size_t *head_len);
+
+#endif
@@ -0,0 +1,41 @@
+// Hammering-webserver suite
+//
+// Rule profiler: what every named rule of the grammar costs
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __PROFILE_H
+#define __PROFILE_H
+
+#include <hammer/hammer.h>
+#include <stdio.h>
+
+// Rules and stack depth we keep track of; past them we stop counting
+#define MAX_PROFILED_RULES 1024
+#define PROFILE_MAX_DEPTH  1024
+
+// Count what p does under name: calls, successes, failures, bytes and
+// ticks. Rules of the same name add up.
+// Only when built with -DPROFILE_RULES does PF_RULE() wrap every named
+// rule in this; see PROFILED() in parser-helpers.h.
+// The wrapper uses attr_bool gates, so the profiled grammar is for the
+// packrat backend.
+HParser *profiled(const char *name, const HParser *p);
+
+// Per rule, sorted by the ticks spent in the rule itself:
+//   calls, ok, failed, bytes matched, bytes backtracked, ticks, self ticks
+// Backtracked bytes are those named rules below it had matched when
+// the rule failed. A call packrat answers from its memo table doesn't
+// run the rule, so doesn't count.
+void profile_report(FILE *out);
+
+// Self ticks per call stack, one "rule;rule;rule ticks" line each:
+// the input of flamegraph.pl. Threads each have their own lines.
+void profile_folded(FILE *out);
+
+// Forget all counts. Neither this nor the reports lock out the threads
+// that parse: call them when it's quiet.
+void profile_reset(void);
+
+#endif
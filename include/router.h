@@ -0,0 +1,31 @@
+// Hammering-webserver suite
+//
+// Router: method and path to a route, in a radix tree
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __ROUTER_H
+#define __ROUTER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct router router_t;
+
+// NULL when out of memory
+router_t *router_new(void);
+
+// Add a route. The path must validate against post_url_chars(), as the
+// url of post() does; it asserts. Returns 0 when method and path are
+// taken already, or out of memory.
+int router_add(router_t *router, const char *method, const char *path, const void *value);
+
+// Look up the method and the request-uri, byte for byte.
+// Returns the value of the route, NULL when there is none.
+const void *router_find(const router_t *router, const uint8_t *method, size_t method_len,
+			const uint8_t *uri, size_t uri_len);
+
+void router_free(router_t *router);
+
+#endif
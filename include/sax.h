@@ -0,0 +1,76 @@
+// Hammering-webserver suite
+//
+// Streaming JSON: callbacks per value, no tree
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __SAX_H
+#define __SAX_H
+
+#include "json.h"
+
+// Default limits
+#define DEFAULT_SAX_DEPTH DEFAULT_JSON_DEPTH  // nested objects and arrays, as json
+#define DEFAULT_SAX_TOKEN (64 * 1024)         // bytes in a name, string or number
+
+// Called for every value as it completes, in document order.
+// Names and strings are decoded; they are gone after the call returns.
+// Return 0 to stop the parse. Leave out (NULL) what you don't need.
+typedef struct {
+  int (*start_object)(void *user_data);
+  int (*end_object)(void *user_data);
+  int (*start_array)(void *user_data);
+  int (*end_array)(void *user_data);
+  int (*key)(void *user_data, const uint8_t *name, size_t len);
+  int (*string)(void *user_data, const uint8_t *s, size_t len);
+  int (*number)(void *user_data, const json_number_t *n);
+  int (*boolean)(void *user_data, int value);
+  int (*null)(void *user_data);
+} json_sax_callbacks_t;
+
+typedef enum {
+  JSON_SAX_MORE,       // feed more, or finish
+  JSON_SAX_DONE,       // one complete value, nothing after it
+  JSON_SAX_REJECT,     // not JSON
+  JSON_SAX_TOO_LARGE,  // nested too deep, or a token over the limit
+  JSON_SAX_STOPPED,    // a callback returned 0
+} json_sax_status_t;
+
+// The parse so far; all the memory it needs is allocated up front
+typedef struct {
+  const json_sax_callbacks_t *cb;
+  void *user_data;
+  size_t max_depth;
+  size_t max_token;
+
+  json_sax_status_t status;
+  int state;                   // see sax.c
+  uint8_t *stack;              // per level: object or array
+  size_t depth;
+  int last_structural;         // the last byte that wasn't white space was one of {}[]:,
+  int ws_pending;              // white space that needs one of {}[]:, next
+
+  uint8_t *buf;                // the name, string or number so far
+  size_t len;
+  int is_key;
+  int hex_pos;                 // in \uXXXX
+  int hex_d, hex_high, hex_low;
+  const char *literal;         // true, false or null, and how far we got
+  size_t literal_pos;
+} json_sax_t;
+
+// Start a parse with the limits. Returns 0 when out of memory.
+int json_sax_init(json_sax_t *sax, const json_sax_callbacks_t *cb, void *user_data,
+		  size_t max_depth, size_t max_token);
+
+// Feed the next piece, any size. Accepts what the json parser accepts,
+// byte for byte. Returns JSON_SAX_MORE until something goes wrong.
+json_sax_status_t json_sax_feed(json_sax_t *sax, const uint8_t *input, size_t length);
+
+// No more input: JSON_SAX_DONE when it was one complete value.
+json_sax_status_t json_sax_finish(json_sax_t *sax);
+
+void json_sax_free(json_sax_t *sax);
+
+#endif
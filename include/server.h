@@ -0,0 +1,63 @@
+// Hammering-webserver suite
+//
+// The web server: an epoll event loop per core around the parsers
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __SERVER_H
+#define __SERVER_H
+
+#include "message.h"
+
+// Default size of the parse context of a connection, in bytes
+#define DEFAULT_CONN_CTX_SIZE (64 * 1024)
+
+// What a handler sends back
+typedef struct {
+  int status;                 // HTTP status code, 200 when the handler leaves it
+  const char *content_type;   // NULL for none
+  const uint8_t *body;        // copied before the handler's next call
+  size_t body_len;
+} response_t;
+
+typedef void (*handler_t)(const message_t *msg, response_t *res, void *user_data);
+
+// A route: the request matches when head_p parses all of its head.
+// See post_head() and parse_message(); wrap head_p in limited() to
+// answer 431 or 413 when a head costs too much (governor.h).
+// With a method and path, the router finds the route by its request
+// line, and head_p parses the rest of the head only: see routed_head().
+typedef struct {
+  const HParser *head_p;
+  const HParser *body_p;      // NULL to take the body as is
+  size_t max_body;
+  handler_t handler;
+  void *user_data;
+  const char *method;         // "POST", ...; with path
+  const char *path;           // NULL to try head_p in turn, after the router
+} route_t;
+
+typedef struct {
+  const char *host;           // address to listen on, NULL for any
+  uint16_t port;              // 0 for any free port, see server_port()
+  int threads;                // event loops, 0 for one per core
+  const route_t *routes;      // by the router, or tried in order
+  size_t routes_len;
+  size_t ctx_size;            // parse context per connection, 0 for the default
+} server_config_t;
+
+typedef struct server server_t;
+
+// Start the event loops, one thread each; they share the parsers,
+// so build those first (init_http_parser(), init_json_parser(), routes).
+// Returns NULL when the sockets or threads can't be set up.
+server_t *server_start(const server_config_t *config);
+
+// The port we listen on
+uint16_t server_port(const server_t *server);
+
+// Stop the event loops, close all connections and free the server
+void server_stop(server_t *server);
+
+#endif
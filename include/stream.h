@@ -0,0 +1,53 @@
+// Hammering-webserver suite
+//
+// Incremental parsing of messages that arrive in pieces
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __STREAM_H
+#define __STREAM_H
+
+#include "prescan.h"
+#include "message.h"
+
+typedef enum {
+  STREAM_MORE,    // feed more input
+  STREAM_DONE,    // message parsed, see msg; msg.consumed bytes were used
+  STREAM_REJECT,  // never going to parse, see status for why
+} stream_status_t;
+
+typedef struct {
+  HAllocator *mm__;             // for the parse results, NULL for the system allocator
+  const HParser *head_p;        // see parse_message()
+  const HParser *body_p;
+  size_t max_head;
+  size_t max_body;
+
+  HSuspendedParser *suspended;  // head parser, when its backend parses in chunks
+  uint8_t *buf;                 // all input so far; the message points into it
+  size_t len;
+  size_t cap;
+  prescan_t scan;               // searched this far for the end of the head
+  size_t head_len;              // 0 until we have the head
+  chunked_t framing;            // checked this far in a chunked body
+
+  message_status_t status;
+  message_t msg;
+} stream_t;
+
+// Start parsing a message that arrives in pieces
+void stream_init(stream_t *s, const HParser *head_p, const HParser *body_p,
+		 size_t max_head, size_t max_body);
+void stream_init__m(HAllocator *mm__, stream_t *s, const HParser *head_p, const HParser *body_p,
+		    size_t max_head, size_t max_body);
+
+// Feed the next piece. Never looks at bytes it saw before.
+// After STREAM_DONE, the bytes from s->buf + s->msg.consumed up to
+// s->buf + s->len are the start of the next message.
+stream_status_t stream_feed(stream_t *s, const uint8_t *input, size_t length);
+
+// Free the buffer and the message
+void stream_free(stream_t *s);
+
+#endif
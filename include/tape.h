@@ -0,0 +1,71 @@
+// Hammering-webserver suite
+//
+// JSON tapes: a parsed JSON value as one flat array of words
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __TAPE_H
+#define __TAPE_H
+
+#include "json.h"
+
+// Every value is one 64 bit word on the tape: its type in the top
+// byte, the rest depends on the type:
+//   '{' '['  the count of elements (24 bits) and the position of the
+//            matching close word (32 bits); skipping a subtree is O(1)
+//   '}' ']'  the position of the open word
+//   '"'      offset of the string in the strings: a 32 bit length,
+//            the bytes and a \0
+//   'l' 'd'  nothing; the next word is the int64_t or the double
+//   't' 'f' 'n'
+// Objects hold a string word for the name, then the value, per member.
+typedef struct {
+  uint64_t *words;
+  size_t len;
+  uint8_t *strings;
+  size_t strings_len;
+} json_tape_t;
+
+typedef enum {
+  JSON_T_OBJECT = '{',
+  JSON_T_ARRAY  = '[',
+  JSON_T_STRING = '"',
+  JSON_T_INT    = 'l',
+  JSON_T_DOUBLE = 'd',
+  JSON_T_TRUE   = 't',
+  JSON_T_FALSE  = 'f',
+  JSON_T_NULL   = 'n',
+  JSON_T_END    = 0,    // past the last element of an object or array
+} json_type_t;
+
+// Where we are on a tape
+typedef struct {
+  const json_tape_t *tape;
+  size_t pos;
+} json_cursor_t;
+
+// Put input on a tape as the SAX parser (sax.h) reads it; it takes
+// what json takes. No tree of tokens gets built: the tape, and a
+// buffer the size of the input while parsing, is all the memory used.
+// Returns 0 when it isn't JSON, or out of memory.
+int json_tape_parse(json_tape_t *tape, const uint8_t *input, size_t length);
+
+// Put a value json has parsed already on a tape, like the one in
+// message_t. Returns 0 when out of memory.
+int json_tape_from(json_tape_t *tape, const HParsedToken *value);
+
+void json_tape_free(json_tape_t *tape);
+
+// The cursor API. A cursor on JSON_T_END has no value, only a type.
+json_cursor_t json_root(const json_tape_t *tape);
+json_type_t json_type(json_cursor_t c);
+json_cursor_t json_next(json_cursor_t c);               // the value after this one, skipping its subtree
+json_cursor_t json_first(json_cursor_t c);              // first element, or the name of the first member
+size_t json_count(json_cursor_t c);                     // elements or members
+int json_find(json_cursor_t c, const uint8_t *name, size_t len, json_cursor_t *value);
+int64_t json_int(json_cursor_t c);
+double json_double(json_cursor_t c);                    // ints too
+const uint8_t *json_string(json_cursor_t c, size_t *len); // \0 terminated
+
+#endif
@@ -0,0 +1,24 @@
+// Hammering-webserver suite
+//
+// User token types
+// One list for the whole library, so the numbers don't collide.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __TOKEN_TYPES_H
+#define __TOKEN_TYPES_H
+
+enum HammeringTokenType {
+    // JSON (json.c)
+    TT_json_object_t = TT_USER,
+    TT_json_array_t,
+    TT_json_number_t,
+    TT_json_literal_t,
+
+    // HTTP (http.c)
+    TT_header_index_t,
+    TT_uri_t,
+};
+
+#endif
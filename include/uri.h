@@ -0,0 +1,48 @@
+// Hammering-webserver suite
+//
+// Request-URI: path segments and query parameters
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#ifndef __URI_H
+#define __URI_H
+
+#include <hammer/hammer.h>
+
+// A name=value pair of the query, as it is in the input: %XX and all.
+// A name without = has an empty value.
+typedef struct {
+  HBytes name;
+  HBytes value;
+} query_param_t;
+
+// What parsed_uri() returns (TT_uri_t). The spans point into the input,
+// see http_parse(); none of them is decoded.
+typedef struct {
+  HBytes path;                  // from the first / up to the ?
+  HBytes query;                 // after the ?, token NULL without one
+  HBytes *segments;             // between the slashes of the path
+  size_t n_segments;
+  query_param_t *params;        // in order; empty pairs (&&) left out
+  size_t n_params;
+  HArena *arena;                // of the parse, for what gets decoded
+} uri_t;
+
+// Split a valid origin-form uri (see request_uri()) into its parts,
+// allocating from arena. NULL when out of memory.
+uri_t *uri_new(HArena *arena, const uint8_t *uri, size_t len);
+
+// The first parameter called name (decoded), NULL when there is none
+const query_param_t *uri_param(const uri_t *uri, const uint8_t *name, size_t len);
+
+// A segment, name or value decoded. It is the span itself when there is
+// no % in it, a copy in the arena of the parse when there is.
+HBytes uri_decode(const uri_t *uri, HBytes raw);
+
+// Decode %XX escapes, out may be in. Every % must have two hex digits
+// after it, as the grammar sees to. Returns the length of out.
+// A + stays a +: that is form encoding, not RFC 3986.
+size_t pct_decode(const uint8_t *in, size_t len, uint8_t *out);
+
+#endif
@@ -2,7 +2,7 @@
 
 while true
 do
-    inotifywait -q -e modify *.[ch] Makefile
+    inotifywait -q -e modify src/*.c include/*.h test/*.[ch] Makefile
     clear
     make clean btest && ./btest || true
 done
@@ -0,0 +1,107 @@
+// Hammering-webserver suite
+//
+// Backend selection for the parsers
+//
+// The library builds the grammars with the combinators; hammer parses
+// them with packrat unless someone calls h_compile for another backend.
+// Here we try the faster backends first and fall back to packrat when
+// a grammar is not regular, LL(k) or LALR.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdint.h>
+#include <assert.h>
+#include "parser-helpers.h"
+#include "http.h"
+#include "backend.h"
+
+// Lookahead to try for the LL(k) backend
+#define LLK_K 2
+
+const HParserBackend backend_preference[] = {
+  PB_REGULAR,
+  PB_LLk,
+  PB_LALR,
+  PB_PACKRAT,
+};
+const size_t backend_preference_len = sizeof(backend_preference) / sizeof(backend_preference[0]);
+
+
+const char *backend_name(HParserBackend backend) {
+  switch (backend) {
+  case PB_PACKRAT: return "packrat";
+  case PB_REGULAR: return "regular";
+  case PB_LLk:     return "llk";
+  case PB_LALR:    return "lalr";
+  case PB_GLR:     return "glr";
+  default:         return "invalid";
+  }
+}
+
+
+// Backend specific compile parameters
+static const void *backend_params(HParserBackend backend) {
+  if (PB_LLk == backend) {
+    return (const void *)(uintptr_t)LLK_K;
+  }
+  return NULL;
+}
+
+int compile_for(HParser *parser, HParserBackend backend) {
+  return 0 == h_compile(parser, backend, backend_params(backend));
+}
+
+
+/* Compile a parser for the fastest backend that accepts it.
+ * h_compile returns non-zero when the grammar does not fit a backend,
+ * so try them in order of preference. Packrat never refuses.
+ * Returns the chosen backend.
+ */
+HParserBackend compile_fastest(HParser *parser) {
+  for (size_t i = 0; i < backend_preference_len; i++) {
+    HParserBackend backend = backend_preference[i];
+    if (compile_for(parser, backend)) {
+      return backend;
+    }
+  }
+  // not reached, packrat accepts everything
+  assert(0);
+  return PB_PACKRAT;
+}
+
+
+/* Compile the exported grammars.
+ * These parsers are shared, so do it once, at startup.
+ */
+void compile_http_parser() {
+  compile_fastest(generic_http_request());
+  compile_fastest(http_response());
+}
+
+
+/* Print a table of rule against backend.
+ * A rule that fails for a backend blocks every grammar that uses it.
+ * The smallest failing rules are the ones to rewrite.
+ * We compile a fresh wrapper around each rule so the shared parser
+ * keeps the backend it has.
+ */
+void backend_report(FILE *out) {
+  fprintf(out, "%-24s", "rule");
+  for (size_t b = 0; b < backend_preference_len; b++) {
+    fprintf(out, " %-8s", backend_name(backend_preference[b]));
+  }
+  fprintf(out, "\n");
+
+  for (size_t i = 0; i < http_rules_len; i++) {
+    fprintf(out, "%-24s", http_rules[i].name);
+    for (size_t b = 0; b < backend_preference_len; b++) {
+      HParserBackend backend = backend_preference[b];
+      HParser *wrapper = h_sequence(http_rules[i].rule(), NULL);
+      int ok = compile_for(wrapper, backend);
+      fprintf(out, " %-8s", ok ? "ok" : "-");
+    }
+    fprintf(out, "\n");
+  }
+}
@@ -0,0 +1,273 @@
+// Hammering-webserver suite
+//
+// Transfer-Encoding: chunked
+//
+// A push decoder for chunked bodies (RFC 7230 section 4.1), strict:
+//
+//   chunked-body = *chunk last-chunk trailer-part CRLF
+//   chunk        = chunk-size [ chunk-ext ] CRLF chunk-data CRLF
+//   chunk-ext    = *( BWS ";" BWS name [ BWS "=" BWS ( token / quoted-string ) ] )
+//   trailer-part = *( header-field CRLF )
+//
+// The size lines and trailers are checked a byte at a time; the data
+// is skipped over by its size and handed to the sink as spans of the
+// input, so a body parser sees the payload without it being put back
+// together first. Extensions and trailers are checked and dropped.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <stdint.h>
+#include <string.h>
+#include "chunked.h"
+
+enum {
+  S_SIZE,             // first hex digit
+  S_SIZE_MORE,        // more hex digits, or what ends them
+  S_EXT_BWS,          // after the size or an extension: BWS ";" or CR
+  S_EXT_NAME_START,   // after ";"
+  S_EXT_NAME,
+  S_EXT_AFTER_NAME,   // BWS "=", ";" or CR
+  S_EXT_VALUE_START,  // after "="
+  S_EXT_TOKEN,
+  S_EXT_QUOTED,
+  S_EXT_QUOTED_PAIR,  // after a backslash
+  S_SIZE_LF,
+  S_DATA,
+  S_DATA_CR,
+  S_DATA_LF,
+  S_TRAILER_START,    // a field name, or CR for the end
+  S_TRAILER_NAME,
+  S_TRAILER_VALUE,
+  S_TRAILER_LF,
+  S_END_LF,
+};
+
+
+void chunked_init(chunked_t *ch, size_t max_body) {
+  memset(ch, 0, sizeof(*ch));
+  ch->max_body = max_body;
+  ch->max_line = DEFAULT_MAX_CHUNK_LINE;
+  ch->max_trailers = DEFAULT_MAX_TRAILERS;
+  ch->status = CHUNKED_MORE;
+  ch->state = S_SIZE;
+}
+
+
+// tchar, RFC 7230 section 3.2.6
+static inline int is_tchar(uint8_t c) {
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+    || (0 != c && NULL != strchr("!#$%&'*+-.^_`|~", c));
+}
+
+// qdtext and the second byte of a quoted-pair, less the quote and backslash
+static inline int is_qdtext(uint8_t c) {
+  return '\t' == c || ' ' == c || (c >= 0x21 && c <= 0x7e && '"' != c && '\\' != c) || c >= 0x80;
+}
+
+// field-vchar and the white space in a field value
+static inline int is_field_char(uint8_t c) {
+  return '\t' == c || (c >= 0x20 && c <= 0x7e) || c >= 0x80;
+}
+
+static inline int hex_value(uint8_t c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static chunked_status_t stop(chunked_t *ch, chunked_status_t status) {
+  ch->status = status;
+  return status;
+}
+
+
+chunked_status_t chunked_feed(chunked_t *ch, const uint8_t *input, size_t length,
+			      chunk_sink_t sink, void *user_data) {
+  if (CHUNKED_MORE != ch->status) {
+    return ch->status;
+  }
+  size_t i = 0;
+  while (i < length) {
+    if (S_DATA == ch->state) {
+      size_t n = length - i < ch->chunk_left ? length - i : ch->chunk_left;
+      if (NULL != sink && !sink(user_data, input + i, n)) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      i += n;
+      ch->used += n;
+      ch->chunk_left -= n;
+      if (0 == ch->chunk_left) {
+	ch->state = S_DATA_CR;
+      }
+      continue;
+    }
+
+    uint8_t c = input[i++];
+    ch->used++;
+    // a trickle of tiny chunks, or long extensions; never an empty body
+    if (++ch->framing > ch->max_body && ch->framing - ch->max_body > ch->max_line) {
+      return stop(ch, CHUNKED_TOO_LARGE);
+    }
+    if ('\r' != c && '\n' != c && ++ch->line_len > ch->max_line) {
+      return stop(ch, CHUNKED_TOO_LARGE);
+    }
+    int bws = ' ' == c || '\t' == c;
+
+    switch (ch->state) {
+    case S_SIZE:
+    case S_SIZE_MORE: {
+      int d = hex_value(c);
+      if (d >= 0) {
+	if (ch->chunk_left > (ch->max_body - ch->payload) >> 4) {
+	  return stop(ch, CHUNKED_TOO_LARGE);
+	}
+	ch->chunk_left = (ch->chunk_left << 4) | d;
+	ch->state = S_SIZE_MORE;
+      } else if (S_SIZE == ch->state) {
+	return stop(ch, CHUNKED_REJECT);
+      } else if (bws) {
+	ch->state = S_EXT_BWS;
+      } else if (';' == c) {
+	ch->state = S_EXT_NAME_START;
+      } else if ('\r' == c) {
+	ch->state = S_SIZE_LF;
+      } else {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      if (ch->chunk_left > ch->max_body - ch->payload) {
+	return stop(ch, CHUNKED_TOO_LARGE);
+      }
+      break;
+    }
+    case S_EXT_BWS:
+      if (';' == c) {
+	ch->state = S_EXT_NAME_START;
+      } else if ('\r' == c) {
+	ch->state = S_SIZE_LF;
+      } else if (!bws) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_NAME_START:
+      if (is_tchar(c)) {
+	ch->state = S_EXT_NAME;
+      } else if (!bws) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_NAME:
+    case S_EXT_AFTER_NAME:
+      if (S_EXT_NAME == ch->state && is_tchar(c)) {
+	break;
+      }
+      if ('=' == c) {
+	ch->state = S_EXT_VALUE_START;
+      } else if (';' == c) {
+	ch->state = S_EXT_NAME_START;
+      } else if ('\r' == c) {
+	ch->state = S_SIZE_LF;
+      } else if (bws) {
+	ch->state = S_EXT_AFTER_NAME;
+      } else {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_VALUE_START:
+      if (is_tchar(c)) {
+	ch->state = S_EXT_TOKEN;
+      } else if ('"' == c) {
+	ch->state = S_EXT_QUOTED;
+      } else if (!bws) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_TOKEN:
+      if (is_tchar(c)) {
+	break;
+      }
+      if (';' == c) {
+	ch->state = S_EXT_NAME_START;
+      } else if ('\r' == c) {
+	ch->state = S_SIZE_LF;
+      } else if (bws) {
+	ch->state = S_EXT_BWS;
+      } else {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_QUOTED:
+      if ('"' == c) {
+	ch->state = S_EXT_BWS;
+      } else if ('\\' == c) {
+	ch->state = S_EXT_QUOTED_PAIR;
+      } else if (!is_qdtext(c)) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_EXT_QUOTED_PAIR:
+      if (!is_qdtext(c) && '"' != c && '\\' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      ch->state = S_EXT_QUOTED;
+      break;
+    case S_SIZE_LF:
+      if ('\n' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      ch->line_len = 0;
+      ch->payload += ch->chunk_left;
+      ch->state = ch->chunk_left ? S_DATA : S_TRAILER_START;
+      break;
+    case S_DATA_CR:
+      if ('\r' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      ch->state = S_DATA_LF;
+      break;
+    case S_DATA_LF:
+      if ('\n' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      ch->state = S_SIZE;
+      break;
+    case S_TRAILER_START:
+      if ('\r' == c) {
+	ch->state = S_END_LF;
+      } else if (is_tchar(c) && ++ch->trailers <= ch->max_trailers) {
+	ch->state = S_TRAILER_NAME;
+      } else {
+	return stop(ch, is_tchar(c) ? CHUNKED_TOO_LARGE : CHUNKED_REJECT);
+      }
+      break;
+    case S_TRAILER_NAME:
+      if (':' == c) {
+	ch->state = S_TRAILER_VALUE;
+      } else if (!is_tchar(c)) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_TRAILER_VALUE:
+      if ('\r' == c) {
+	ch->state = S_TRAILER_LF;
+      } else if (!is_field_char(c)) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      break;
+    case S_TRAILER_LF:
+      if ('\n' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      ch->line_len = 0;
+      ch->state = S_TRAILER_START;
+      break;
+    case S_END_LF:
+      if ('\n' != c) {
+	return stop(ch, CHUNKED_REJECT);
+      }
+      return stop(ch, CHUNKED_DONE);
+    }
+  }
+  return CHUNKED_MORE;
+}
@@ -0,0 +1,111 @@
+// Hammering-webserver suite
+//
+// Parse contexts: a reusable arena per connection
+//
+// Every h_parse makes a new arena from malloc, and the parse results go
+// back with free. A parse context hands hammer a bump allocator over one
+// region instead: allocation is a pointer increment, free does nothing,
+// and between two requests on a connection we reset the whole region
+// at once. What doesn't fit goes to malloc and is freed at the reset.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http.h"
+#include "context.h"
+
+// Every block starts with its size, for realloc.
+// Keep the header and the blocks aligned for anything.
+#define CTX_ALIGN  16
+#define CTX_HEADER CTX_ALIGN
+#define ALIGN_UP(n) (((n) + CTX_ALIGN - 1) & ~(CTX_ALIGN - 1))
+
+
+static void note_high_water(parse_ctx_t *ctx) {
+  size_t total = ctx->used + ctx->overflow_bytes;
+  if (total > ctx->high_water) {
+    ctx->high_water = total;
+  }
+}
+
+static void *ctx_alloc(HAllocator *allocator, size_t size) {
+  parse_ctx_t *ctx = (parse_ctx_t *)allocator;
+  size_t need = CTX_HEADER + ALIGN_UP(size);
+  uint8_t *block;
+
+  if (need <= ctx->size - ctx->used) {
+    block = ctx->region + ctx->used;
+    ctx->used += need;
+  } else {
+    // doesn't fit, chain it to the overflow list
+    ctx_overflow_t *o = malloc(ALIGN_UP(sizeof(ctx_overflow_t)) + need);
+    if (NULL == o) {
+      return NULL;
+    }
+    o->next = ctx->overflow;
+    ctx->overflow = o;
+    ctx->overflow_bytes += need;
+    block = (uint8_t *)o + ALIGN_UP(sizeof(ctx_overflow_t));
+  }
+  note_high_water(ctx);
+  *(size_t *)block = size;
+  return block + CTX_HEADER;
+}
+
+static void *ctx_realloc(HAllocator *allocator, void *ptr, size_t size) {
+  if (NULL == ptr) {
+    return ctx_alloc(allocator, size);
+  }
+  size_t old = *(size_t *)((uint8_t *)ptr - CTX_HEADER);
+  if (size <= old) {
+    return ptr;
+  }
+  void *grown = ctx_alloc(allocator, size);
+  if (NULL != grown) {
+    memcpy(grown, ptr, old);
+  }
+  return grown;
+}
+
+static void ctx_free(HAllocator *allocator, void *ptr) {
+  // everything goes at the reset
+}
+
+
+int parse_ctx_init(parse_ctx_t *ctx, size_t size) {
+  memset(ctx, 0, sizeof(*ctx));
+  ctx->allocator.alloc = ctx_alloc;
+  ctx->allocator.realloc = ctx_realloc;
+  ctx->allocator.free = ctx_free;
+  ctx->size = ALIGN_UP(size);
+  ctx->region = malloc(ctx->size); // malloc aligns for anything
+  return NULL != ctx->region;
+}
+
+/* Reset the context
+ * O(1), unless the last parses overflowed the region.
+ */
+void parse_ctx_reset(parse_ctx_t *ctx) {
+  while (NULL != ctx->overflow) {
+    ctx_overflow_t *next = ctx->overflow->next;
+    free(ctx->overflow);
+    ctx->overflow = next;
+  }
+  ctx->overflow_bytes = 0;
+  ctx->used = 0;
+}
+
+void parse_ctx_free(parse_ctx_t *ctx) {
+  parse_ctx_reset(ctx);
+  free(ctx->region);
+  memset(ctx, 0, sizeof(*ctx));
+}
+
+
+HParseResult *ctx_parse(parse_ctx_t *ctx, const HParser *parser, const uint8_t *input, size_t length) {
+  return http_parse__m(&ctx->allocator, parser, input, length);
+}
@@ -0,0 +1,135 @@
+// Hammering-webserver suite
+//
+// Resource governor: limits on what one parse may cost
+//
+// The pre-scan bounds the head before the grammar sees it. Inside the
+// grammar, limited() puts the limits of a route on this thread at the
+// start of the parse, and gates in the repetitions count headers and
+// JSON values and look at the arena: packrat memo tables and tokens
+// alike come from there. A gate that finds a limit crossed fails, and
+// so does every gate after it; the parse unwinds without going deeper.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <hammer/glue.h>
+#include "parser-helpers.h"
+#include "prescan.h"
+#include "governor.h"
+
+const parse_limits_t default_parse_limits = {
+  DEFAULT_MAX_HEADERS,
+  DEFAULT_MAX_LINE,
+  DEFAULT_MAX_TOKENS,
+  DEFAULT_MAX_ARENA,
+};
+
+// The running limited() parse on this thread
+static __thread const parse_limits_t *gov_limits = NULL;
+static __thread size_t gov_tokens = 0;
+static __thread size_t gov_headers = 0;
+static __thread parse_limit_t gov_exceeded = LIMIT_NONE;
+
+void governor_begin(void) {
+  gov_limits = NULL;
+  gov_tokens = 0;
+  gov_headers = 0;
+  gov_exceeded = LIMIT_NONE;
+}
+
+void governor_end(void) {
+  gov_limits = NULL;
+}
+
+parse_limit_t governor_exceeded(void) {
+  return gov_exceeded;
+}
+
+static bool exceed(parse_limit_t limit) {
+  gov_exceeded = limit;
+  return false;
+}
+
+// attr_bool only asks about parses with a token
+HParsedToken *act_gate(const HParseResult *p, void *user_data) {
+  return H_MAKE_UINT(0);
+}
+
+static bool start_limits(HParseResult *p, void *user_data) {
+  governor_begin();
+  gov_limits = user_data;
+  return true;
+}
+
+// Done, one way or the other: the limits go, what we found stays
+static bool stop_limits(HParseResult *p, void *user_data) {
+  gov_limits = NULL;
+  return true;
+}
+
+static bool stop_failed(HParseResult *p, void *user_data) {
+  gov_limits = NULL;
+  return false;
+}
+
+static bool token_ok(HParseResult *p, void *user_data) {
+  if (NULL == gov_limits) {
+    return true;
+  }
+  if (LIMIT_NONE != gov_exceeded) {
+    return false;
+  }
+  if (gov_limits->max_tokens && ++gov_tokens > gov_limits->max_tokens) {
+    return exceed(LIMIT_TOKENS);
+  }
+  if (gov_limits->max_arena) {
+    HArenaStats stats;
+    h_allocator_stats(p->arena, &stats);
+    if (stats.used + stats.wasted > gov_limits->max_arena) {
+      return exceed(LIMIT_ARENA);
+    }
+  }
+  return true;
+}
+
+static bool header_ok(HParseResult *p, void *user_data) {
+  if (!token_ok(p, user_data)) {
+    return false;
+  }
+  if (NULL != gov_limits && gov_limits->max_headers && ++gov_headers > gov_limits->max_headers) {
+    return exceed(LIMIT_HEADERS);
+  }
+  return true;
+}
+
+// A (name value) header, after the fact
+static bool header_line_ok(HParseResult *p, void *user_data) {
+  if (NULL == gov_limits || 0 == gov_limits->max_line) {
+    return true;
+  }
+  const HParsedToken *name = h_seq_index(p->ast, 0);
+  const HParsedToken *value = h_seq_index(p->ast, 1);
+  size_t len = name->bytes.len + 2 + (TT_BYTES == value->token_type ? value->bytes.len : 0);
+  return len <= gov_limits->max_line || exceed(LIMIT_LINE);
+}
+
+static PF_RULE(stop_gate, h_attr_bool(h_action(h_epsilon_p(), act_gate, NULL), stop_limits, NULL));
+
+static PF_RULE(stop_fail_gate, h_attr_bool(h_action(h_epsilon_p(), act_gate, NULL), stop_failed, NULL));
+
+HParser *limited(const HParser *p, const parse_limits_t *limits) {
+  HParser *start = h_attr_bool(h_action(h_epsilon_p(), act_gate, NULL),
+			       start_limits, (void *)(limits ? limits : &default_parse_limits));
+  return h_choice(h_left(h_right(start, p), stop_gate()),
+		  stop_fail_gate(),
+		  NULL);
+}
+
+PF_RULE(token_gate, h_attr_bool(h_action(h_epsilon_p(), act_gate, NULL), token_ok, NULL));
+
+static PF_RULE(header_gate, h_attr_bool(h_action(h_epsilon_p(), act_gate, NULL), header_ok, NULL));
+
+HParser *governed_header(const HParser *header_p) {
+  return h_right(header_gate(), h_attr_bool(header_p, header_line_ok, NULL));
+}
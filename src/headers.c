@@ -0,0 +1,207 @@
+// Hammering-webserver suite
+//
+// Known header names
+//
+// A perfect hash maps every known header name to its own slot, so
+// recognising a header costs one hash over the name and one compare,
+// no matter how many names we know.
+// The hash is FNV-1a over the lower-cased name, starting at HEADER_SEED;
+// the slot is the top byte.
+// If you add a name: search a seed that gives every name its own slot
+// and regenerate header_slots. test_header_ids checks it.
+//
+// The header index uses the same hash for the names we don't know,
+// in a small open addressing table next to the fixed slots of the
+// known ones.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+#include "headers.h"
+
+#define HEADER_SEED  35u
+#define FNV_PRIME    16777619u
+
+const char *const header_names[HDR_KNOWN_MAX] = {
+  [HDR_UNKNOWN] = NULL,
+  [HDR_ACCEPT_RANGES] = "Accept-Ranges",
+  [HDR_AGE] = "Age",
+  [HDR_ETAG] = "ETag",
+  [HDR_LOCATION] = "Location",
+  [HDR_PROXY_AUTHENTICATE] = "Proxy-Authenticate",
+  [HDR_RETRY_AFTER] = "Retry-After",
+  [HDR_VARY] = "Vary",
+  [HDR_WWW_AUTHENTICATE] = "WWW-Authenticate",
+  [HDR_ALLOW] = "Allow",
+  [HDR_CONTENT_ENCODING] = "Content-Encoding",
+  [HDR_CONTENT_LANGUAGE] = "Content-Language",
+  [HDR_CONTENT_LENGTH] = "Content-Length",
+  [HDR_CONTENT_LOCATION] = "Content-Location",
+  [HDR_CONTENT_MD5] = "Content-MD5",
+  [HDR_CONTENT_RANGE] = "Content-Range",
+  [HDR_CONTENT_TYPE] = "Content-Type",
+  [HDR_EXPIRES] = "Expires",
+  [HDR_LAST_MODIFIED] = "Last-Modified",
+  [HDR_CACHE_CONTROL] = "Cache-Control",
+  [HDR_CONNECTION] = "Connection",
+  [HDR_DATE] = "Date",
+  [HDR_PRAGMA] = "Pragma",
+  [HDR_TRAILER] = "Trailer",
+  [HDR_TRANSFER_ENCODING] = "Transfer-Encoding",
+  [HDR_UPGRADE] = "Upgrade",
+  [HDR_VIA] = "Via",
+  [HDR_WARNING] = "Warning",
+  [HDR_ACCEPT] = "Accept",
+  [HDR_ACCEPT_CHARSET] = "Accept-Charset",
+  [HDR_ACCEPT_ENCODING] = "Accept-Encoding",
+  [HDR_ACCEPT_LANGUAGE] = "Accept-Language",
+  [HDR_AUTHORIZATION] = "Authorization",
+  [HDR_EXPECT] = "Expect",
+  [HDR_FROM] = "From",
+  [HDR_HOST] = "Host",
+  [HDR_IF_MATCH] = "If-Match",
+  [HDR_IF_MODIFIED_SINCE] = "If-Modified-Since",
+  [HDR_IF_NONE_MATCH] = "If-None-Match",
+  [HDR_IF_RANGE] = "If-Range",
+  [HDR_IF_UNMODIFIED_SINCE] = "If-Unmodified-Since",
+  [HDR_MAX_FORWARDS] = "Max-Forwards",
+  [HDR_PROXY_AUTHORIZATION] = "Proxy-Authorization",
+  [HDR_RANGE] = "Range",
+  [HDR_REFERER] = "Referer",
+  [HDR_TE] = "TE",
+  [HDR_USER_AGENT] = "User-Agent",
+  [HDR_COOKIE] = "Cookie",
+};
+
+// Slot -> header id
+static const uint8_t header_slots[256] = {
+   0, 30,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 21,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 16, 31,  0,
+   0,  0, 15,  0,  0,  0, 23,  0,  0,  0,  0,  0,  0, 47,  0, 11,
+   0,  0,  0,  0,  0,  0, 12, 42, 32,  0,  0,  0, 22,  0, 40,  7,
+   0,  0,  0,  0,  0,  5,  0, 25,  0,  4,  0,  0,  0,  0,  0, 24,
+   0,  0,  0,  0,  0,  0, 14,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+  43,  0,  0,  8,  0,  0,  0,  0, 19,  0,  0,  0,  0, 44,  0,  0,
+   0, 39, 35,  0, 29,  0, 37,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0, 13,  0,  0, 45,  0,  0,  1,  0,  0,  0,  0,  0,  0,  0,
+   0,  0, 36, 28, 18,  9,  0,  0,  0,  0,  0,  2,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 26,  0,  0,
+   0,  0,  0,  0,  0, 41,  0, 20,  0, 10,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 34,  0,  0,  0,  0,  6,
+   0,  0,  0,  0,  0,  0,  0, 33,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  3,  0,  0, 46, 17,  0,  0, 27, 38,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+};
+
+
+uint32_t header_hash(const uint8_t *name, size_t len) {
+  uint32_t h = HEADER_SEED;
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ (name[i] | 0x20)) * FNV_PRIME;
+  }
+  return h;
+}
+
+
+header_id_t header_id(const uint8_t *name, size_t len) {
+  header_id_t id = header_slots[header_hash(name, len) >> 24];
+  if (HDR_UNKNOWN == id
+      || len != strlen(header_names[id])
+      || 0 != strncasecmp((const char *)name, header_names[id], len)) {
+    return HDR_UNKNOWN;
+  }
+  return id;
+}
+
+
+int is_response_header(header_id_t id) {
+  return id >= HDR_ACCEPT_RANGES && id <= HDR_WWW_AUTHENTICATE;
+}
+
+int is_entity_header(header_id_t id) {
+  return id >= HDR_ALLOW && id <= HDR_LAST_MODIFIED;
+}
+
+
+//----------------------------------
+// Header index
+
+static int same_name(const HParsedToken *a, const uint8_t *name, size_t len) {
+  return a->bytes.len == len && 0 == strncasecmp((const char *)a->bytes.token, (const char *)name, len);
+}
+
+// Append e to the list that starts at *first
+static void append(header_entry_t **first, header_entry_t *e) {
+  while (NULL != *first) {
+    first = &(*first)->next;
+  }
+  *first = e;
+}
+
+// Find the slot for name: the one holding it, or the empty one where it goes
+static header_entry_t **other_slot(const header_index_t *index, const uint8_t *name, size_t len) {
+  size_t i = header_hash(name, len) & index->other_mask;
+  while (NULL != index->other[i] && !same_name(index->other[i]->name, name, len)) {
+    i = (i + 1) & index->other_mask;
+  }
+  return &index->other[i];
+}
+
+
+/* Index the headers.
+ * The table for unknown names is at most half full, so probes stay short.
+ * Duplicates chain off the first one with their name.
+ */
+header_index_t *header_index_new(HArena *arena, const HParsedToken *headers) {
+  size_t count = headers->seq->used;
+  header_index_t *index = h_arena_malloc(arena, sizeof(header_index_t));
+  header_entry_t *entries = h_arena_malloc(arena, (count ? count : 1) * sizeof(header_entry_t));
+  memset(index->known, 0, sizeof(index->known));
+  index->headers = headers;
+
+  size_t size = 4;
+  while (size < 2 * count) {
+    size *= 2;
+  }
+  index->other = h_arena_malloc(arena, size * sizeof(header_entry_t *));
+  memset(index->other, 0, size * sizeof(header_entry_t *));
+  index->other_mask = size - 1;
+
+  for (size_t i = 0; i < count; i++) {
+    const HParsedToken *header = headers->seq->elements[i];
+    header_entry_t *e = &entries[i];
+    e->name = header->seq->elements[0];
+    e->value = header->seq->elements[1];
+    e->next = NULL;
+
+    header_id_t id = header_id(e->name->bytes.token, e->name->bytes.len);
+    if (HDR_UNKNOWN != id) {
+      append(&index->known[id], e);
+    } else {
+      append(other_slot(index, e->name->bytes.token, e->name->bytes.len), e);
+    }
+  }
+  return index;
+}
+
+
+const header_entry_t *header_index_get(const header_index_t *index, header_id_t id) {
+  if (id <= HDR_UNKNOWN || id >= HDR_KNOWN_MAX) {
+    return NULL;
+  }
+  return index->known[id];
+}
+
+
+const header_entry_t *header_index_find(const header_index_t *index, const uint8_t *name, size_t len) {
+  header_id_t id = header_id(name, len);
+  if (HDR_UNKNOWN != id) {
+    return index->known[id];
+  }
+  return *other_slot(index, name, len);
+}
@@ -10,7 +10,13 @@
 #include <hammer/glue.h>
 #include "parser-helpers.h"
 #include "http.h"
+#include "headers.h"
+#include "governor.h"
+#include "uri.h"
+#include "dfa.h"
+#include "token-types.h"
 #include <string.h>
+#include <pthread.h>
 
 
 //----------------------------------------
@@ -35,14 +41,12 @@ HParsedToken *act_lws(const HParseResult *p, void *user_data) {
 /* Parse Linear whitespace (LWS)
  * LWS = [CRLF] 1*( SP | HT )
  */
-HParser *lws() {
-  return h_action(h_sequence(h_optional(crlf()),
-			     h_many1(h_choice(sp(),
-					      tab(),
-					      NULL)),
-			     NULL),
-		  act_lws, NULL);
-}
+PF_RULE(lws, h_action(h_sequence(h_optional(crlf()),
+				 h_many1(h_choice(sp(),
+						  tab(),
+						  NULL)),
+				 NULL),
+		      act_lws, NULL));
 
 
 //------------------------------------------------
@@ -54,9 +58,7 @@ HParser *lws() {
 HParsedToken *sequence_to_bytes(const HParseResult *p, void *user_data) {
   assert(TT_SEQUENCE == p->ast->token_type);
   // printf("\nunamb seq: %s\n", h_write_result_unamb(p->ast));
-  const HParsedToken *seq = h_seq_flatten(p->arena, p->ast);
-  size_t len = h_seq_len(seq);
-  return token_to_bytes(p->arena, seq, user_data);
+  return token_to_bytes(p->arena, p->ast, user_data);
 }
 
 HParsedToken *token_to_bytes(HArena *arena, const HParsedToken *t, void *user_data) {
@@ -64,11 +66,11 @@ HParsedToken *token_to_bytes(HArena *arena, const HParsedToken *t, void *user_da
   // printf("\nunamb seq: %s\n", h_write_result_unamb(t));
   const HParsedToken *seq = h_seq_flatten(arena, t);
   size_t len = h_seq_len(seq);
-  
-  //uint8_t *arr = h_arena_malloc(p->arena, len +1); // +1 for \0
+  HParsedToken **elems = h_seq_elements(seq);
+
   uint8_t *arr = h_arena_malloc(arena, len +1); // +1 for \0
-  for (uint8_t i=0; i < len; i++) {
-    arr[i] = h_seq_index(seq, i)->uint;
+  for (size_t i=0; i < len; i++) {
+    arr[i] = elems[i]->uint;
   }
   arr[len] = 0; // make it a printf-able c-string
 
@@ -82,6 +84,83 @@ HParsedToken *token_to_bytes(HArena *arena, const HParsedToken *t, void *user_da
 }
 
 
+//------------------------------------------------
+// Spans
+//
+// Header names, values, status codes and urls come back as TT_BYTES.
+// When the parse runs through http_parse() we know the input buffer,
+// and these point straight into it: no copy, no terminating \0.
+// Without it, or when LWS folding changed the bytes, they are copied
+// by token_to_bytes().
+
+// Input of the running http_parse() on this thread
+static __thread const uint8_t *span_input = NULL;
+static __thread size_t span_input_len = 0;
+
+/* Parse input, returning spans into it instead of copies.
+ * The results stay valid for as long as the input does.
+ */
+HParseResult *http_parse(const HParser *parser, const uint8_t *input, size_t length) {
+  return http_parse__m(NULL, parser, input, length);
+}
+
+/* Same, allocating from mm__ (see parse_ctx_t), NULL for the system allocator.
+ */
+HParseResult *http_parse__m(HAllocator *mm__, const HParser *parser, const uint8_t *input, size_t length) {
+  const uint8_t *outer_input = span_input;
+  size_t outer_len = span_input_len;
+
+  span_input = input;
+  span_input_len = length;
+  governor_begin();
+  HParseResult *res = mm__ ? h_parse__m(mm__, parser, input, length) : h_parse(parser, input, length);
+  governor_end();
+  span_input = outer_input;
+  span_input_len = outer_len;
+  return res;
+}
+
+/* Find what the parser matched in the input of http_parse()
+ * Returns NULL when we don't know the input.
+ */
+const uint8_t *matched_span(const HParseResult *p, size_t *len) {
+  if (NULL == span_input || p->bit_length <= 0) {
+    return NULL;
+  }
+  size_t start = p->ast->index;
+  *len = p->bit_length / 8;
+  if (start > span_input_len || *len > span_input_len - start) {
+    return NULL;
+  }
+  return span_input + start;
+}
+
+/* Action: the matched bytes, as they are in the input
+ * For names, status codes and urls, the grammar never changes bytes.
+ */
+HParsedToken *act_span(const HParseResult *p, void *user_data) {
+  size_t len;
+  const uint8_t *span = matched_span(p, &len);
+  if (NULL == span) {
+    return sequence_to_bytes(p, user_data);
+  }
+  return H_MAKE_BYTES(span, len);
+}
+
+/* Action: a header value
+ * Folding (CRLF 1*(SP|HT)) collapses into a single space, that's the
+ * only place the value differs from the input. Copy only then.
+ */
+HParsedToken *act_header_value(const HParseResult *p, void *user_data) {
+  size_t len;
+  const uint8_t *span = matched_span(p, &len);
+  if (NULL == span || NULL != memchr(span, '\r', len)) {
+    return sequence_to_bytes(p, user_data);
+  }
+  return H_MAKE_BYTES(span, len);
+}
+
+
 /* Parse a header
  * It needs a parser for a name and one for a value
  * Returns: (name value) tuple
@@ -98,22 +177,20 @@ HParser *header(HParser *name_p, HParser *value_p) {
 /* Parse any header name
  * Deviate a bit from the spec in RFC 2616 sec 2.2 (token)
  */
-HParser *any_header_name() {
-  uint8_t *allowed = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_.";
-  return h_action(h_many1(h_in(allowed, strlen(allowed))),
-		  sequence_to_bytes, NULL);
-}
+PF_RULE(any_header_name, h_action(h_many1(h_in(LEN("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+						   "abcdefghijklmnopqrstuvwxyz"
+						   "0123456789"
+						   "-_."))),
+				  act_span, NULL));
 
 
 /* Parse any header_value
  *  value = *( field-content | LWS )
  */
-HParser *any_header_value() {
-  return h_action(h_many(h_choice(reason_text(),
-				  lws(),
-				  NULL)),
-		  sequence_to_bytes, NULL);
-}
+PF_RULE(any_header_value, h_action(h_many(h_choice(reason_text(),
+						   lws(),
+						   NULL)),
+				   act_header_value, NULL));
 
 //-----------------------------------------
 // General header (RFC 2616 sec 4.2)
@@ -127,12 +204,15 @@ HParser *any_header_value() {
 
 PF_RULE(general_header, header(any_header_name(), any_header_value()));
 
+// Validates a complete header name, used by header_name() at construction time.
+static PF_RULE(header_name_check, END(any_header_name()));
+
 // Header name
 // Match that the name is valid,
 // Return a parser for the name
 HParser *header_name(uint8_t *name) {
   // Test the name against the allowed syntax for header names
-  assert(NULL != h_parse(END(any_header_name()), name, strlen(name)));
+  assert(NULL != h_parse(header_name_check(), name, strlen(name)));
   return h_token(name, strlen(name));
 }
 
@@ -144,38 +224,41 @@ HParser *named_header(uint8_t *name) {
   return header(header_name(name), any_header_value());
 }
 
+//-----------------------------------------
+// Known headers
+// We parse the header as a general header and look the name up in the
+// perfect hash of known names (see headers.c), case-insensitive.
+// One hash instead of trying every named_header() literal in turn.
+
+// The id of the name of a parsed (name value) header
+static header_id_t parsed_header_id(const HParseResult *p) {
+  const HBytes *name = &h_seq_index(p->ast, 0)->bytes;
+  return header_id(name->token, name->len);
+}
+
+static bool validate_response_header(HParseResult *p, void *user_data) {
+  return is_response_header(parsed_header_id(p));
+}
+
+static bool validate_entity_header(HParseResult *p, void *user_data) {
+  return is_entity_header(parsed_header_id(p));
+}
+
 //-----------------------------------------
 // HTTP RESPONSE headers (RFC 2616 section 6.2)
+// Accept-Ranges, Age, ETag, Location, Proxy-Authenticate, Retry-After, Vary, WWW-Authenticate
 // Notice: we ignore all the definitions for any of these, so any header value is accepted
 // TODO: implement specific header with definitions in section 14.
-PF_RULE(response_header, h_choice(
-				  named_header("Accept-Ranges"),
-				  named_header("Age"),
-				  named_header("ETag"),
-				  named_header("Location"),
-				  named_header("Proxy-Authenticate"),
-				  named_header("Retry-After"),
-				  named_header("Vary"),
-				  named_header("WWW-Authenticate"),
-				  NULL));
+PF_RULE(response_header, h_attr_bool(general_header(), validate_response_header, NULL));
 
 
 //-----------------------------------------
 // HTTP ENTITY headers (RFC 2616 section 7)
+// Allow, Content-Encoding, Content-Language, Content-Length, Content-Location,
+// Content-MD5, Content-Range, Content-Type, Expires, Last-Modified
 // Notice: we ignore all the definitions for any of these, so any header value is accepted
 // TODO: implement specific header with definitions in section 14.
-PF_RULE(entity_header, h_choice(
-				named_header("Allow"),
-				named_header("Content-Encoding"),
-				named_header("Content-Language"),
-				named_header("Content-Length"),
-				named_header("Content-Location"),
-				named_header("Content-MD5"),
-				named_header("Content-Range"),
-				named_header("Content-Type"),
-				named_header("Expires"),
-				named_header("Last-Modified"),
-				NULL));
+PF_RULE(entity_header, h_attr_bool(general_header(), validate_entity_header, NULL));
 
 /* Parse headers.
  * Parameters: a parser
@@ -202,8 +285,57 @@ PF_RULE(any_method, h_choice(get_method(),
 			     NULL));
 
 
-PF_RULE(path, h_many1(h_ch_range(33, 126))); // TODO: make it more URL-like
-PF_RULE(request_uri, path());
+//----------------------------------------
+// REQUEST-URI (RFC 3986, origin-form of RFC 7230 section 5.3.1)
+//
+// origin-form   = absolute-path [ "?" query ]
+// absolute-path = 1*( "/" segment )
+// segment       = *pchar
+// query         = *( pchar / "/" / "?" )
+// pchar         = unreserved / pct-encoded / sub-delims / ":" / "@"
+
+PF_RULE(pct_encoded, h_sequence(h_ch('%'),
+				h_in(LEN("0123456789abcdefABCDEF")),
+				h_in(LEN("0123456789abcdefABCDEF")),
+				NULL));
+PF_RULE(pchar, h_choice(h_in(LEN("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+				 "abcdefghijklmnopqrstuvwxyz"
+				 "0123456789"
+				 "-._~"          // unreserved
+				 "!$&'()*+,;="   // sub-delims
+				 ":@")),
+			pct_encoded(),
+			NULL));
+
+static PF_RULE(absolute_path, h_many1(h_sequence(h_ch('/'),
+						h_many(pchar()),
+						NULL)));
+
+PF_RULE(path, h_action(absolute_path(), act_span, NULL));
+
+/* Parse the request-uri, strictly.
+ * Returns the uri as it is (TT_BYTES), see parsed_uri() for its parts.
+ * A query may have a ? in it, so '?' query repeats instead of being
+ * optional: the same bytes, and no TT_NONE in the sequence.
+ */
+PF_RULE(request_uri, h_action(h_sequence(absolute_path(),
+					 h_many(h_sequence(h_ch('?'),
+							   h_many(h_choice(pchar(),
+									   h_in(LEN("/?")),
+									   NULL)),
+							   NULL)),
+					 NULL),
+			      act_span, NULL));
+
+HParsedToken *act_uri(const HParseResult *p, void *user_data) {
+  return H_MAKE(uri_t, uri_new(p->arena, p->ast->bytes.token, p->ast->bytes.len));
+}
+
+/* Parse the request-uri into path segments and query parameters.
+ * Use it as the url parser of request_line(), for GET handlers.
+ * Returns: a uri_t (TT_uri_t), see uri.h
+ */
+PF_RULE(parsed_uri, h_action(request_uri(), act_uri, NULL));
 PF_RULE(post_url_chars, h_many1(h_in(LEN("ABCDEFGHIJKLMNOPQRSTUVWXYZ"
 					 "abcdefghijklmnopqrstuvwxyz"
 					 "0123456789"
@@ -220,6 +352,31 @@ PF_RULE(any_request_line, h_sequence(any_method(),
 				     h_ignore(crlf()),
 				     NULL));
 
+/* Split a request line into its method and uri, as any_request_line()
+ * would, with the generated DFAs: the line is all regular.
+ * Returns 0 when it isn't a request line.
+ */
+int scan_request_line(const uint8_t *line, size_t len, HBytes *method, HBytes *uri) {
+  size_t n, at;
+  if (!dfa_any_method(line, len, &n) || n == len || ' ' != line[n]) {
+    return 0;
+  }
+  method->token = line;
+  method->len = n;
+  at = n + 1;
+  if (!dfa_request_uri(line + at, len - at, &n) || at + n == len || ' ' != line[at + n]) {
+    return 0;
+  }
+  uri->token = line + at;
+  uri->len = n;
+  at += n + 1;
+  if (!dfa_http_version(line + at, len - at, &n)) {
+    return 0;
+  }
+  at += n;
+  return len - at == 2 && '\r' == line[at] && '\n' == line[at + 1];
+}
+
 /* Parse a request_line 
  * Parameters: 
  * - method-parser; i.e.: GET, HEAD, POST, CONNECT;
@@ -237,36 +394,97 @@ HParser *request_line(HParser *method, HParser *url) {
 }
 
 
+/* Parse any header.
+ * Known or not, they all parse the same; use header_id() on the name
+ * to tell which one it is.
+ * Returns: (name value) tuple
+ */
+PF_RULE(any_header, general_header());
+
+HParsedToken *act_request_headers(const HParseResult *p, void *user_data) {
+  return H_MAKE(header_index_t, header_index_new(p->arena, p->ast));
+}
+
+/* Parse all the headers of a message, and index them.
+ * Within limited(), each header counts against the limits.
+ * Returns: a header_index_t (TT_header_index_t)
+ *   index->headers is the sequence of (name value) tuples
+ */
+PF_RULE(request_headers, h_action(h_many(governed_header(any_header())),
+				  act_request_headers, NULL));
+
 /* Parse a generic http request.
  * It matches any valid request and does not validate any individual parts.
  * Caller must validate all data returned.
- * Returns: three-tuple (url, headers, body)
+ * Returns: three-tuple (url, header-index, body)
  */
 PF_RULE(generic_http_request, h_sequence(any_request_line(),
-					 h_many(h_choice(response_header(),
-							 entity_header(),
-							 general_header(),
-							 NULL)),
+					 request_headers(),
 					 h_ignore(crlf()),
 					 h_optional(message_body()),
 					 NULL));
 
+/* Parse the head of a generic http request, up to and including the empty line.
+ * Use it with parse_message() to frame the body by Content-Length.
+ * Returns: two-tuple (request-line header-index)
+ */
+PF_RULE(any_request_head, h_sequence(any_request_line(),
+				     request_headers(),
+				     h_ignore(crlf()),
+				     NULL));
+
+// Validates a complete POST url, used by post() at construction time.
+static PF_RULE(post_url_check, END(post_url_chars()));
+
+/* Is url a valid POST url? See post_url_chars().
+ */
+int post_url_valid(uint8_t *url) {
+  return NULL != h_parse(post_url_check(), url, strlen(url));
+}
+
 /* Parse a specific POST request.
  * Parameters:
  * - url: the literal url; must validate against post_url_chars
  * - header-parser: a parser to parse all headers; tip: use h_permutation(...)
  * - body-parser: a parser to parse the request body.
  * For json-request, use a json parser.
+ * - limits: what the parse may cost, NULL for default_parse_limits
  * Returns a three-tuple of the url and what the header and body parsers return. 
  */
-HParser *post(uint8_t* url, HParser *header_p, HParser *body) {
+HParser *post(uint8_t* url, HParser *header_p, HParser *body, const parse_limits_t *limits) {
   //printf("url is: >>%s<<\n", url);
-  assert(NULL != h_parse(END(post_url_chars()), url, strlen(url)));
+  assert(post_url_valid(url));
+  HParser *url_p = h_token(url, strlen(url));
+  return limited(h_sequence(request_line(post_method(), url_p),
+			    headers(header_p),
+			    h_ignore(crlf()),
+			    body,
+			    NULL),
+		 limits);
+}
+
+/* Parse the head of a specific POST request.
+ * Like post() but stops after the empty line,
+ * use it with parse_message() to parse the body.
+ * Returns a two-tuple of the url and what the header parser returns.
+ */
+HParser *post_head(uint8_t* url, HParser *header_p) {
+  assert(post_url_valid(url));
   HParser *url_p = h_token(url, strlen(url));
   return h_sequence(request_line(post_method(), url_p),
 		    headers(header_p),
 		    h_ignore(crlf()),
-		    body,
+		    NULL);
+}
+
+/* Parse the head of a request after its request line.
+ * For the server's router, which takes the request line and finds
+ * the route by method and path (see router.h).
+ * Returns a one-tuple of what the header parser returns.
+ */
+HParser *routed_head(HParser *header_p) {
+  return h_sequence(headers(header_p),
+		    h_ignore(crlf()),
 		    NULL);
 }
 
@@ -290,14 +508,11 @@ HParser *post(uint8_t* url, HParser *header_p, HParser *body) {
 /* Parse a generic HTTP response
  * It matches any valid response
  * Caller needs to validate all data returned.
- * Returns: tuple: (status code, headers, body)
+ * Returns: tuple: (status code, header-index, body)
  * TODO: rename to: any_http_response
  */
 PF_RULE(http_response, h_sequence(status_line(any_status_code()),
-				  h_many(h_choice(response_header(),
-						  entity_header(),
-						  general_header(),
-						  NULL)),
+				  request_headers(),
 				  h_ignore(crlf()),
 				  h_optional(message_body()),
 				  NULL));
@@ -319,6 +534,27 @@ HParser *status_line(HParser *status_code) {
 		  h_sequence(sp(), reason_phrase(), crlf(), NULL));
 }
 
+/* Split a status line, the way scan_request_line() does.
+ * Returns 0 when it isn't a status line.
+ */
+int scan_status_line(const uint8_t *line, size_t len, HBytes *code) {
+  size_t n, at;
+  if (!dfa_http_version(line, len, &n) || n == len || ' ' != line[n]) {
+    return 0;
+  }
+  at = n + 1;
+  if (!dfa_any_status_code(line + at, len - at, &n) || at + n == len || ' ' != line[at + n]) {
+    return 0;
+  }
+  code->token = line + at;
+  code->len = n;
+  at += n + 1;
+  while (at < len && dfa_reason_text(line + at, len - at, &n)) {
+    at += n;
+  }
+  return len - at == 2 && '\r' == line[at] && '\n' == line[at + 1];
+}
+
 //-----------------------------------------
 // Status codes
 //
@@ -343,17 +579,16 @@ HParser* status_code(uint8_t* code) {
 /* Parse any status code matches anything in range 100-599
  * Returns the parsed code
  */
-HParser *any_status_code(void) {
-  return h_action(h_sequence(h_ch_range('1', '5'), h_ch_range('0', '9'), h_ch_range('0', '9'), NULL),
-		  sequence_to_bytes, NULL);
-}
+PF_RULE(any_status_code, h_action(h_sequence(h_ch_range('1', '5'), h_ch_range('0', '9'), h_ch_range('0', '9'), NULL),
+				  act_span, NULL));
 
 //-----------------------------------------
 // Message body
 
 /* Parse a message body.
  * it matches anything, unconditionally.
- * Use this parser only to match until EOF
+ * Use this parser only to match until EOF,
+ * use parse_message() to frame a body by its Content-Length.
  * Returns the parsed data.
  */
 PF_RULE(message_body, h_many(h_ch_range(0, 255)));
@@ -372,3 +607,70 @@ PF_RULE(reason_text, h_choice(ascii(),
 				tab(),
 				NULL));
 
+
+//----------------------------------
+// Registry
+//
+// All parameterless rules, by name. Each of them caches its parser on
+// first use; init_http_parser() builds them all up front.
+const http_rule_t http_rules[] = {
+  { "sp",                   sp },
+  { "tab",                  tab },
+  { "cr",                   cr },
+  { "lf",                   lf },
+  { "crlf",                 crlf },
+  { "ascii",                ascii },
+  { "reason_text",          reason_text },
+  { "lws",                  lws },
+  { "any_header_name",      any_header_name },
+  { "any_header_value",     any_header_value },
+  { "general_header",       general_header },
+  { "response_header",      response_header },
+  { "entity_header",        entity_header },
+  { "message_body",         message_body },
+  { "get_method",           get_method },
+  { "post_method",          post_method },
+  { "any_method",           any_method },
+  { "path",                 path },
+  { "request_uri",          request_uri },
+  { "pct_encoded",          pct_encoded },
+  { "pchar",                pchar },
+  { "parsed_uri",           parsed_uri },
+  { "post_url_chars",       post_url_chars },
+  { "any_request_line",     any_request_line },
+  { "any_header",           any_header },
+  { "request_headers",      request_headers },
+  { "generic_http_request", generic_http_request },
+  { "any_request_head",     any_request_head },
+  { "http_version",         http_version },
+  { "reason_phrase",        reason_phrase },
+  { "any_status_code",      any_status_code },
+  { "status_code_200",      status_code_200 },
+  { "status_code_201",      status_code_201 },
+  { "status_code_400",      status_code_400 },
+  { "status_code_403",      status_code_403 },
+  { "status_code_404",      status_code_404 },
+  { "status_code_409",      status_code_409 },
+  { "status_code_500",      status_code_500 },
+  { "http_response",        http_response },
+};
+const size_t http_rules_len = sizeof(http_rules) / sizeof(http_rules[0]);
+
+
+static pthread_once_t http_once = PTHREAD_ONCE_INIT;
+
+static void build_http_parser(void) {
+  for (size_t i = 0; i < http_rules_len; i++) {
+    http_rules[i].rule();
+  }
+  header_name_check();
+  post_url_check();
+}
+
+/* Build every HTTP parser once.
+ * Like init_json_parser(): any thread may call it, any number of times;
+ * they all return once the parsers are complete.
+ */
+void init_http_parser() {
+  pthread_once(&http_once, build_http_parser);
+}
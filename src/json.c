@@ -13,10 +13,15 @@
 #include <hammer/glue.h>
 #include "parser-helpers.h"
 #include "json.h"
+#include "http.h"
+#include "token-types.h"
 #include "test_suite.h"
 #include <glib.h>
 #include <stdio.h>
 #include <string.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
 
 // global json parser
 HParser *json;
@@ -31,26 +36,25 @@ HParser *lit_true;
 HParser *lit_false;
 HParser *lit_null;
 
-HParser *colon;
 HParser *ws;
+HParser *comma;
+HParser *json_char;
 HParser *any_name_value_pair;
 
 // JSON sub-parsers (non-exported)
-HParser *quote;
-HParser *comma;
-HParser *left_curly_bracket;
-HParser *right_curly_bracket;
-
+static HParser *colon;
+static HParser *quote;
+static HParser *left_curly_bracket;
+static HParser *right_curly_bracket;
+static HParser *left_square_bracket;
+static HParser *right_square_bracket;
+static HParser *json_scalar;
 
-enum JSONTokenType {
-    TT_json_object_t = TT_USER,
-    TT_json_array_t,
-    TT_json_string_t
-};
+// build them once
+static pthread_once_t json_once = PTHREAD_ONCE_INIT;
 
 typedef HParsedToken* json_object_t;
 typedef HParsedToken* json_array_t;
-typedef HParsedToken* json_string_t;
 
 HParsedToken *act_json_any_object(const HParseResult *p, void *user_data) {
     const HParsedToken *tok = p->ast;
@@ -61,31 +65,360 @@ HParsedToken *act_json_any_array(const HParseResult *p, void *user_data) {
     return H_MAKE(json_array_t, p->ast->seq);
 }
 
-HParsedToken *act_json_any_string(const HParseResult *p, void *user_data) {
-    return H_MAKE(json_string_t, p->ast->seq);
+// true, false and null, so they don't look like strings
+static const json_literal_t json_literals[] = { JSON_FALSE, JSON_TRUE, JSON_NULL };
+
+HParsedToken *act_json_literal(const HParseResult *p, void *user_data) {
+    return H_MAKE(json_literal_t, user_data);
 }
 
 
-void init_json_parser() {
+
+// Count and copy the characters of a token tree of single characters.
+// Only what fits in max gets copied; returns the count of all of them.
+static size_t token_chars(const HParsedToken *t, uint8_t *buf, size_t pos, size_t max) {
+    switch (t->token_type) {
+    case TT_UINT:
+	if (pos < max) {
+	    buf[pos] = (uint8_t)t->uint;
+	}
+	return pos + 1;
+    case TT_SEQUENCE:
+	for (size_t i = 0; i < t->seq->used; i++) {
+	    pos = token_chars(t->seq->elements[i], buf, pos, max);
+	}
+	return pos;
+    default:
+	return pos; // a missing optional part
+    }
+}
+
+
+//----------------------------------------
+// Strings
+//
+// A string comes back as TT_BYTES, without the quotes. When the parse
+// runs through http_parse() and there is no backslash in it, that
+// points into the input. Otherwise it is a decoded copy.
+
+static int hex_value(uint8_t c) {
+    if (c <= '9') {
+	return c - '0';
+    }
+    return (c | 0x20) - 'a' + 10;
+}
+
+static uint32_t hex4(const uint8_t *s) {
+    return hex_value(s[0]) << 12 | hex_value(s[1]) << 8 | hex_value(s[2]) << 4 | hex_value(s[3]);
+}
+
+static size_t put_utf8(uint8_t *out, uint32_t c) {
+    if (c < 0x80) {
+	out[0] = c;
+	return 1;
+    }
+    if (c < 0x800) {
+	out[0] = 0xC0 | c >> 6;
+	out[1] = 0x80 | (c & 0x3F);
+	return 2;
+    }
+    if (c < 0x10000) {
+	out[0] = 0xE0 | c >> 12;
+	out[1] = 0x80 | (c >> 6 & 0x3F);
+	out[2] = 0x80 | (c & 0x3F);
+	return 3;
+    }
+    out[0] = 0xF0 | c >> 18;
+    out[1] = 0x80 | (c >> 12 & 0x3F);
+    out[2] = 0x80 | (c >> 6 & 0x3F);
+    out[3] = 0x80 | (c & 0x3F);
+    return 4;
+}
+
+/* Resolve the escapes in the body of a string the grammar accepted.
+ * It's never longer than the escaped text: out needs len bytes, and
+ * may be in itself. Returns the decoded length.
+ */
+size_t json_unescape(const uint8_t *in, size_t len, uint8_t *out) {
+    size_t o = 0;
+    for (size_t i = 0; i < len; i++) {
+	if ('\\' != in[i]) {
+	    out[o++] = in[i];
+	    continue;
+	}
+	i++;
+	switch (in[i]) {
+	case 'b': out[o++] = '\b'; break;
+	case 'f': out[o++] = '\f'; break;
+	case 'n': out[o++] = '\n'; break;
+	case 'r': out[o++] = '\r'; break;
+	case 't': out[o++] = '\t'; break;
+	case 'u': {
+	    uint32_t c = hex4(in + i + 1);
+	    i += 4;
+	    if (c >= 0xD800 && c <= 0xDBFF) {
+		// the grammar only lets a high surrogate in with its low one
+		c = 0x10000 + ((c - 0xD800) << 10) + (hex4(in + i + 3) - 0xDC00);
+		i += 6;
+	    }
+	    o += put_utf8(out + o, c);
+	    break;
+	}
+	default: out[o++] = in[i]; break; // " \ /
+	}
+    }
+    return o;
+}
+
+HParsedToken *act_json_string(const HParseResult *p, void *user_data) {
+    size_t len = 0;
+    const uint8_t *raw = matched_span(p, &len);
+    if (NULL == raw) {
+	// no input to point into: gather the characters
+	len = token_chars(p->ast, NULL, 0, 0);
+	uint8_t *copy = h_arena_malloc(p->arena, len + 1);
+	token_chars(p->ast, copy, 0, len);
+	raw = copy;
+    }
+    if (NULL == memchr(raw, '\\', len)) {
+	return H_MAKE_BYTES(raw, len);
+    }
+    uint8_t *decoded = h_arena_malloc(p->arena, len);
+    return H_MAKE_BYTES(decoded, json_unescape(raw, len, decoded));
+}
+
+
+//----------------------------------------
+// Numbers
+
+// Exact powers of ten as doubles, up to the last one that is exact
+static const double pow10_exact[] = {
+    1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+#define MAX_DIGITS 19  // that many decimal digits always fit in a uint64_t
+
+static int is_digit(uint8_t c) {
+    return c >= '0' && c <= '9';
+}
+
+/* Are the 8 bytes at s all digits? Then put their value in *v.
+ * SWAR: all eight at once in a 64 bit word, little-endian only.
+ */
+static int eight_digits(const uint8_t *s, uint64_t *v) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    uint64_t w;
+    memcpy(&w, s, 8);
+    if (0 != (((w & 0xF0F0F0F0F0F0F0F0) |
+	       (((w + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ^ 0x3333333333333333)) {
+	return 0;
+    }
+    w -= 0x3030303030303030;
+    w = (w * 10) + (w >> 8);    // pairs
+    w = (((w & 0x000000FF000000FF) * (100 + (1000000ULL << 32))) +
+	 (((w >> 16) & 0x000000FF000000FF) * (1 + (10000ULL << 32)))) >> 32;
+    *v = w;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/* Gather digits from s[*i] on into the mantissa m.
+ * Digits past the first MAX_DIGITS significant ones don't fit; they
+ * only count in *dropped. Returns the number of digits read.
+ */
+static size_t digits(const uint8_t *s, size_t len, size_t *i, uint64_t *m, int *nd, int *dropped) {
+    size_t start = *i;
+    while (*i < len) {
+	uint64_t eight;
+	if (*nd > 0 && *nd + 8 <= MAX_DIGITS && *i + 8 <= len && eight_digits(s + *i, &eight)) {
+	    *m = *m * 100000000 + eight;
+	    *nd += 8;
+	    *i += 8;
+	    continue;
+	}
+	if (!is_digit(s[*i])) {
+	    break;
+	}
+	if (*nd < MAX_DIGITS) {
+	    *m = *m * 10 + (s[*i] - '0');
+	    if (*m > 0) {
+		(*nd)++; // leading zeros aren't significant
+	    }
+	} else {
+	    (*dropped)++;
+	}
+	(*i)++;
+    }
+    return *i - start;
+}
+
+/* Convert a JSON number in one pass.
+ * Integers that fit become int64_t. The rest become doubles: exact
+ * when the digits fit in 53 bits and the power of ten is exact too,
+ * otherwise strtod() on the text does the rounding (C locale).
+ */
+int json_decode_number(const uint8_t *s, size_t len, json_number_t *out) {
+    size_t i = 0;
+    int neg = 0;
+    uint64_t m = 0;
+    int nd = 0, dropped = 0;
+    int64_t exp10 = 0;
+    int integral = 1;
+
+    if (i < len && '-' == s[i]) {
+	neg = 1;
+	i++;
+    }
+    size_t int_start = i;
+    if (0 == digits(s, len, &i, &m, &nd, &dropped) || ('0' == s[int_start] && i - int_start > 1)) {
+	return 0;
+    }
+    exp10 += dropped;
+
+    if (i < len && '.' == s[i]) {
+	integral = 0;
+	i++;
+	int frac_dropped = 0;
+	size_t n = digits(s, len, &i, &m, &nd, &frac_dropped);
+	if (0 == n) {
+	    return 0;
+	}
+	exp10 -= (int64_t)(n - frac_dropped);
+	dropped += frac_dropped;
+    }
+
+    if (i < len && ('e' == s[i] || 'E' == s[i])) {
+	integral = 0;
+	i++;
+	int exp_neg = 0;
+	if (i < len && ('+' == s[i] || '-' == s[i])) {
+	    exp_neg = '-' == s[i];
+	    i++;
+	}
+	if (i == len || !is_digit(s[i])) {
+	    return 0;
+	}
+	int64_t e = 0;
+	for (; i < len && is_digit(s[i]); i++) {
+	    if (e < 100000) {
+		e = e * 10 + (s[i] - '0'); // way out of range already
+	    }
+	}
+	exp10 += exp_neg ? -e : e;
+    }
+    if (i != len) {
+	return 0;
+    }
+
+    if (integral && 0 == dropped && !(neg && 0 == m)) {
+	if (!neg && m <= (uint64_t)INT64_MAX) {
+	    out->kind = JSON_INT;
+	    out->i = (int64_t)m;
+	    return 1;
+	}
+	if (neg && m <= (uint64_t)INT64_MAX + 1) {
+	    out->kind = JSON_INT;
+	    out->i = (int64_t)(0 - m);
+	    return 1;
+	}
+    }
+
+    out->kind = JSON_DOUBLE;
+    if (0 == dropped && m <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+	double d = (double)m;
+	d = exp10 < 0 ? d / pow10_exact[-exp10] : d * pow10_exact[exp10];
+	out->d = neg ? -d : d;
+	return 1;
+    }
+    // strtod() wants a \0 at the end: on a copy, s may be the input
+    char small[64];
+    char *text = len < sizeof(small) ? small : malloc(len + 1);
+    if (NULL == text) {
+	return 0;
+    }
+    memcpy(text, s, len);
+    text[len] = 0;
+    out->d = strtod(text, NULL);
+    if (small != text) {
+	free(text);
+    }
+    return 1;
+}
+
+HParsedToken *act_json_number(const HParseResult *p, void *user_data) {
+    size_t len = 0;
+    const uint8_t *text = matched_span(p, &len);
+    if (NULL == text) {
+	// no input to point into: gather the characters
+	len = token_chars(p->ast, NULL, 0, 0);
+	uint8_t *copy = h_arena_malloc(p->arena, len);
+	token_chars(p->ast, copy, 0, len);
+	text = copy;
+    }
+    json_number_t *num = h_arena_malloc(p->arena, sizeof(json_number_t));
+    if (!json_decode_number(text, len, num)) {
+	return NULL; // can't happen, the grammar checked it
+    }
+    return H_MAKE(json_number_t, num);
+}
+
+
+/* Values with objects and arrays nested up to depth levels
+ * One set of parsers per level, each holding the values of the level
+ * below: the grammar itself ends at depth, there is no recursion for
+ * an attacker to run down. Every value passes the token gate.
+ * Returns the value parser, and the object, array and name-value pair
+ * parsers of the top level.
+ */
+static HParser *nested_value(size_t depth, HParser **object, HParser **array, HParser **pair) {
+    assert(depth > 0);
+    HParser *value = PROFILED("json_value", h_right(token_gate(), json_scalar));
+    for (size_t level = 1; level <= depth; level++) {
+	*array = h_action(h_middle(left_square_bracket,
+				   h_sepBy(value, comma),
+				   right_square_bracket),
+			  act_json_any_array, NULL);
+	*array = PROFILED("json_any_array", *array);
+	*pair = h_sequence(json_any_string,
+			   colon,
+			   value,
+			   NULL);
+	*pair = PROFILED("any_name_value_pair", *pair);
+	*object = h_action(h_middle(left_curly_bracket,
+				    h_sepBy(*pair, comma),
+				    right_curly_bracket),
+			   act_json_any_object, NULL);
+	*object = PROFILED("json_any_object", *object);
+	value = h_right(token_gate(), h_choice(*object,
+					       *array,
+					       json_scalar,
+					       NULL));
+	value = PROFILED("json_value", value);
+    }
+    return value;
+}
+
+
+static void build_json_parser(void) {
     /* Whitespace */
     EH_RULE(ws, h_in((uint8_t*)" \r\n\t", 4));
 
     /* Structural tokens */
-    H_RULE( left_square_bracket,  h_ignore(h_sequence(h_many(ws), h_ch('['), h_many(ws), NULL)));
-    H_RULE(right_square_bracket,  h_ignore(h_sequence(h_many(ws), h_ch(']'), h_many(ws), NULL)));
+    EH_RULE( left_square_bracket, h_ignore(h_sequence(h_many(ws), h_ch('['), h_many(ws), NULL)));
+    EH_RULE(right_square_bracket, h_ignore(h_sequence(h_many(ws), h_ch(']'), h_many(ws), NULL)));
     EH_RULE( left_curly_bracket,  h_ignore(h_sequence(h_many(ws), h_ch('{'), h_many(ws), NULL)));
     EH_RULE(right_curly_bracket,  h_ignore(h_sequence(h_many(ws), h_ch('}'), h_many(ws), NULL)));
     EH_RULE(colon,                h_ignore(h_sequence(h_many(ws), h_ch(':'), h_many(ws), NULL)));
     EH_RULE(comma,                h_ignore(h_sequence(h_many(ws), h_ch(','), h_many(ws), NULL)));
 
     /* Literal tokens */
-    EH_RULE(lit_true,  h_literal("true"));
-    EH_RULE(lit_false, h_literal("false"));
-    EH_RULE(lit_null,  h_literal("null"));
+    EH_RULE(lit_true,  h_action(h_literal("true"),  act_json_literal, (void *)&json_literals[JSON_TRUE]));
+    EH_RULE(lit_false, h_action(h_literal("false"), act_json_literal, (void *)&json_literals[JSON_FALSE]));
+    EH_RULE(lit_null,  h_action(h_literal("null"),  act_json_literal, (void *)&json_literals[JSON_NULL]));
 
-    /* Forward declarations */
-    HParser *value = h_indirect();
-    
     /* Numbers */
     H_RULE(minus, h_ch('-'));
     H_RULE(dot,   h_ch('.'));
@@ -95,22 +428,24 @@ void init_json_parser() {
     H_RULE(exp, h_choice(h_ch('E'), h_ch('e'), NULL));    
     H_RULE(plus, h_ch('+'));
 
-    json_any_number = h_sequence(h_optional(minus),
-				 h_choice(zero,
-					  h_sequence(non_zero_digit,
-						     h_many(digit),
-						     NULL),
+    json_any_number = h_action(h_sequence(h_optional(minus),
+					  h_choice(zero,
+						   h_sequence(non_zero_digit,
+							      h_many(digit),
+							      NULL),
+						   NULL),
+					  h_optional(h_sequence(dot,
+								h_many1(digit),
+								NULL)),
+					  h_optional(h_sequence(exp,
+								h_optional(h_choice(plus,
+										    minus,
+										    NULL)),
+								h_many1(digit),
+								NULL)),
 					  NULL),
-				 h_optional(h_sequence(dot,
-						       h_many1(digit),
-						       NULL)),
-				 h_optional(h_sequence(exp,
-						       h_optional(h_choice(plus,
-									   minus,
-									   NULL)),
-						       h_many1(digit),
-						       NULL)),
-				 NULL);
+			       act_json_number, NULL);
+    json_any_number = PROFILED("json_any_number", json_any_number);
     
     /* Strings */
     EH_RULE(quote,        h_ch('"'));
@@ -123,47 +458,61 @@ void init_json_parser() {
     H_RULE(esc_lf,        h_sequence(backslash, h_ch('n'), NULL));
     H_RULE(esc_cr,        h_sequence(backslash, h_ch('r'), NULL));
     H_RULE(esc_tab,       h_sequence(backslash, h_ch('t'), NULL));
+
+    // \uXXXX: any code point but the surrogates, those come in pairs
+    H_RULE(u,             h_sequence(backslash, h_ch('u'), NULL));
+    H_RULE(hex,           h_in((uint8_t*)"0123456789abcdefABCDEF", 22));
+    H_RULE(esc_bmp,       h_sequence(u, h_choice(h_sequence(h_in((uint8_t*)"0123456789abcefABCEF", 20), hex, NULL),
+						 h_sequence(h_in((uint8_t*)"dD", 2), h_in((uint8_t*)"01234567", 8), NULL),
+						 NULL),
+				     hex, hex, NULL));
+    H_RULE(esc_high,      h_sequence(u, h_in((uint8_t*)"dD", 2), h_in((uint8_t*)"89abAB", 6), hex, hex, NULL));
+    H_RULE(esc_low,       h_sequence(u, h_in((uint8_t*)"dD", 2), h_in((uint8_t*)"cdefCDEF", 8), hex, hex, NULL));
+    H_RULE(esc_unicode,   h_choice(esc_bmp, h_sequence(esc_high, esc_low, NULL), NULL));
+
     H_RULE(escaped,       h_choice(esc_quote, esc_backslash, esc_slash, esc_backspace,
-			     esc_ff, esc_lf, esc_cr, esc_tab, NULL));
+			     esc_ff, esc_lf, esc_cr, esc_tab, esc_unicode, NULL));
     H_RULE(unescaped, h_not_in((uint8_t*)"\"\\\x00\x01\x02\x03\x04\x05\x06\x07\x08\x09\x0A\x0B\x0C\x0D\x0E\x0F\x10\x11\x12\x13\x14\x15\x16\x17\x18\x19\x1A\x1B\x1C\x1D\x1E\x1F", 34));
     EH_RULE(json_char, h_choice(escaped, unescaped, NULL));
 
-    json_any_string = h_action(h_middle(quote,
-					h_many(json_char),
-					quote),
-			       act_json_any_string, NULL);
-    
-    /* Arrays */
-    json_any_array = h_action(h_middle(left_square_bracket,
-				       h_sepBy(value, comma),
-				       right_square_bracket),
-			      act_json_any_array, NULL);
-
-    /* Objects */
-    EH_RULE(any_name_value_pair, h_sequence(json_any_string,
-					    colon,
-					    value,
-					    NULL));
-
-    json_any_object = h_action(h_middle(left_curly_bracket,
-					h_sepBy(any_name_value_pair, comma),
-					right_curly_bracket),
-			       act_json_any_object, NULL);
+    json_any_string = h_middle(quote,
+			       h_action(h_many(json_char), act_json_string, NULL),
+			       quote);
+    json_any_string = PROFILED("json_any_string", json_any_string);
     
-    h_bind_indirect(value, h_choice(json_any_object,
-				    json_any_array,
-				    json_any_number,
-				    json_any_string,
-				    lit_true,
-				    lit_false,
-				    lit_null,
-				    NULL));
+    /* Arrays and objects */
+    json_scalar = h_choice(json_any_number,
+			   json_any_string,
+			   lit_true,
+			   lit_false,
+			   lit_null,
+			   NULL);
+    json_scalar = PROFILED("json_scalar", json_scalar);
+    HParser *value = nested_value(DEFAULT_JSON_DEPTH, &json_any_object, &json_any_array, &any_name_value_pair);
 
     // the main json parser, it parses any value.
     json = h_sequence(value, NULL);
 }
 
 
+/* A json parser for values nested up to max_depth levels
+ * json itself stops at DEFAULT_JSON_DEPTH.
+ */
+HParser *json_bounded(size_t max_depth) {
+    HParser *object, *array, *pair;
+    return h_sequence(nested_value(max_depth, &object, &array, &pair), NULL);
+}
+
+
+/* Build the JSON parsers.
+ * pthread_once() makes every caller wait until they are complete,
+ * so threads can call this on startup without a lock of their own.
+ */
+void init_json_parser() {
+    pthread_once(&json_once, build_json_parser);
+}
+
+
 // Parse a specific name-value-pair
 HParser *json_name_value_pair(uint8_t* name, HParser* value_p) {
   assert(NULL != h_parse(h_sequence(h_many(json_char), h_end_p(), NULL), name, strlen(name)));
@@ -183,6 +532,7 @@ HParser *json_name_value_pair(uint8_t* name, HParser* value_p) {
  * Or a h_permutation of (NV-pair1, comma, NV-pair2, comma, etc)
  * (explicitly add the commas.
  * Returns what your parser returns
+ * For fields in any order, json_object_schema() is stricter and faster.
  */
 HParser *json_object(HParser *parser) {
   return h_middle(left_curly_bracket,
@@ -191,5 +541,140 @@ HParser *json_object(HParser *parser) {
 }
 
 
+//----------------------------------------
+// Objects by schema
+//
+// A member is its name, then the value parser of the field with that
+// name: h_bind() looks the name up in a hash table while parsing, so
+// each member costs one lookup, whatever the order. h_sepBy() does the
+// commas. At the end we check for duplicate and missing fields.
+
+typedef struct {
+  size_t n_fields;
+  json_field_t *fields;
+  HParser **value_ps;   // per field: colon and its value, tagged with the field
+  size_t *index;        // per field: its number, for the tag
+  size_t mask;          // hash table of the names, size mask + 1
+  size_t *slots;        // field + 1, 0 for empty
+  HParser *unknown;     // a name we don't know: fail
+} json_schema_t;
+
+static size_t schema_hash(const uint8_t *name, size_t len) {
+  uint32_t h = 2166136261u; // FNV-1a
+  for (size_t i = 0; i < len; i++) {
+    h = (h ^ name[i]) * 16777619u;
+  }
+  return h;
+}
+
+static const json_field_t *schema_find(const json_schema_t *schema, const uint8_t *name, size_t len, size_t *field) {
+  for (size_t slot = schema_hash(name, len) & schema->mask; 0 != schema->slots[slot]; slot = (slot + 1) & schema->mask) {
+    const json_field_t *f = &schema->fields[schema->slots[slot] - 1];
+    if (strlen(f->name) == len && 0 == memcmp(f->name, name, len)) {
+      *field = schema->slots[slot] - 1;
+      return f;
+    }
+  }
+  return NULL;
+}
+
+// The member value: (field number, value)
+HParsedToken *act_schema_member(const HParseResult *p, void *user_data) {
+  HParsedToken *member = H_MAKE_SEQN(2);
+  h_seq_snoc(member, H_MAKE_UINT(*(size_t *)user_data));
+  h_seq_snoc(member, p->ast);
+  return member;
+}
+
+// Pick the value parser by the name we just parsed
+static HParser *schema_member(HAllocator *mm__, const HParsedToken *name, void *env) {
+  const json_schema_t *schema = env;
+  size_t field;
+  if (NULL == schema_find(schema, name->bytes.token, name->bytes.len, &field)) {
+    return schema->unknown;
+  }
+  return schema->value_ps[field];
+}
+
+// Every field at most once, the required ones exactly once
+static bool validate_schema_object(HParseResult *p, void *user_data) {
+  const json_schema_t *schema = user_data;
+  uint8_t *seen = h_arena_malloc(p->arena, schema->n_fields);
+  memset(seen, 0, schema->n_fields);
+  for (size_t i = 0; i < p->ast->seq->used; i++) {
+    size_t field = p->ast->seq->elements[i]->seq->elements[0]->uint;
+    if (seen[field]++) {
+      return false;
+    }
+  }
+  for (size_t i = 0; i < schema->n_fields; i++) {
+    if (JSON_REQUIRED == schema->fields[i].presence && !seen[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// The values in the order of the schema, TT_NONE for missing fields
+HParsedToken *act_schema_object(const HParseResult *p, void *user_data) {
+  const json_schema_t *schema = user_data;
+  HParsedToken *values = H_MAKE_SEQN(schema->n_fields);
+  for (size_t i = 0; i < schema->n_fields; i++) {
+    h_seq_snoc(values, h_make(p->arena, TT_NONE, NULL));
+  }
+  for (size_t i = 0; i < p->ast->seq->used; i++) {
+    const HParsedToken *member = p->ast->seq->elements[i];
+    values->seq->elements[member->seq->elements[0]->uint] = member->seq->elements[1];
+  }
+  return values;
+}
+
+/* Parse an object by its fields, in any order
+ * Each name must be a field of the schema, once; required fields
+ * must be there. Unknown names, duplicates and stray commas fail.
+ * Returns a sequence with the value of each field, in the order of
+ * fields; a TT_NONE token for an optional field that wasn't there.
+ * Build it once, like any parser: it keeps its own copy of fields.
+ */
+HParser *json_object_schema(const json_field_t *fields, size_t n_fields) {
+  json_schema_t *schema = calloc(1, sizeof(json_schema_t));
+  assert(NULL != schema);
+  schema->n_fields = n_fields;
+  schema->fields = malloc(n_fields * sizeof(json_field_t));
+  schema->value_ps = malloc(n_fields * sizeof(HParser *));
+  schema->index = malloc(n_fields * sizeof(size_t));
+  size_t size = 4;
+  while (size < 2 * n_fields) {
+    size *= 2;
+  }
+  schema->mask = size - 1;
+  schema->slots = calloc(size, sizeof(size_t));
+  assert(NULL != schema->fields && NULL != schema->value_ps && NULL != schema->index && NULL != schema->slots);
+  memcpy(schema->fields, fields, n_fields * sizeof(json_field_t));
+
+  for (size_t i = 0; i < n_fields; i++) {
+    const uint8_t *name = (const uint8_t *)fields[i].name;
+    size_t len = strlen(fields[i].name), dup;
+    assert(NULL == memchr(name, '"', len) && NULL == memchr(name, '\\', len));
+    assert(NULL == schema_find(schema, name, len, &dup));
+
+    size_t slot = schema_hash(name, len) & schema->mask;
+    while (0 != schema->slots[slot]) {
+      slot = (slot + 1) & schema->mask;
+    }
+    schema->slots[slot] = i + 1;
+    schema->index[i] = i;
+    schema->value_ps[i] = h_action(h_right(colon, fields[i].value_p), act_schema_member, &schema->index[i]);
+  }
+  schema->unknown = h_nothing_p();
+
+  HParser *member = h_bind(json_any_string, schema_member, schema);
+  HParser *object = json_object(h_action(h_attr_bool(h_sepBy(member, comma), validate_schema_object, schema),
+					 act_schema_object, schema));
+  return PROFILED("json_object_schema", object);
+}
+
+
+
 /* Parse the idiotic json body prefix */
 PF_RULE(json_prefix, h_literal(")]}'\r\n"));
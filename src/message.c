@@ -0,0 +1,422 @@
+// Hammering-webserver suite
+//
+// HTTP message framing
+//
+// The grammar parses the head: request line, headers and the empty line.
+// The Content-Length header tells where the body ends. We take the body
+// as a single span of the input and hand only that to the body parser,
+// so the body never goes through a byte-by-byte h_many.
+// A chunked body goes through the decoder in chunked.c instead.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <hammer/glue.h>
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "parser-helpers.h"
+#include "http.h"
+#include "headers.h"
+#include "uri.h"
+#include "token-types.h"
+#include "prescan.h"
+#include "message.h"
+#include "chunked.h"
+
+
+// Is tok a (name value) tuple of bytes?
+static int is_header(const HParsedToken *tok) {
+  return TT_SEQUENCE == tok->token_type
+    && 2 == h_seq_len(tok)
+    && TT_BYTES == h_seq_index(tok, 0)->token_type
+    && TT_BYTES == h_seq_index(tok, 1)->token_type;
+}
+
+/* Find a header in a parsed head.
+ * The shape of the head depends on the header parser the caller gave
+ * to post_head(), so search all of it for a header index or for
+ * (name value) tuples.
+ * Returns the first value, or NULL.
+ */
+const HParsedToken *find_header(const HParsedToken *head, const uint8_t *name) {
+  if (NULL != head && TT_header_index_t == (int)head->token_type) {
+    const header_entry_t *e = header_index_find(head->user, name, strlen(name));
+    return e ? e->value : NULL;
+  }
+  if (NULL == head || TT_SEQUENCE != head->token_type) {
+    return NULL;
+  }
+  if (is_header(head)) {
+    const HBytes *n = &h_seq_index(head, 0)->bytes;
+    if (n->len == strlen(name) && 0 == strncasecmp(n->token, name, n->len)) {
+      return h_seq_index(head, 1);
+    }
+    return NULL;
+  }
+  for (size_t i = 0; i < h_seq_len(head); i++) {
+    const HParsedToken *found = find_header(h_seq_index(head, i), name);
+    if (NULL != found) {
+      return found;
+    }
+  }
+  return NULL;
+}
+
+/* Count the headers with name.
+ */
+static size_t count_headers(const HParsedToken *head, const uint8_t *name) {
+  if (NULL != head && TT_header_index_t == (int)head->token_type) {
+    size_t count = 0;
+    for (const header_entry_t *e = header_index_find(head->user, name, strlen(name)); e; e = e->next) {
+      count++;
+    }
+    return count;
+  }
+  if (NULL == head || TT_SEQUENCE != head->token_type) {
+    return 0;
+  }
+  if (is_header(head)) {
+    return NULL != find_header(head, name);
+  }
+  size_t count = 0;
+  for (size_t i = 0; i < h_seq_len(head); i++) {
+    count += count_headers(h_seq_index(head, i), name);
+  }
+  return count;
+}
+
+/* Is token one of the comma-separated tokens in value, case-insensitive?
+ */
+static int has_token(const HBytes *value, const char *token) {
+  size_t len = strlen(token);
+  size_t i = 0;
+  while (i < value->len) {
+    while (i < value->len && (' ' == value->token[i] || '\t' == value->token[i] || ',' == value->token[i])) {
+      i++;
+    }
+    size_t start = i;
+    while (i < value->len && ',' != value->token[i]) {
+      i++;
+    }
+    size_t end = i;
+    while (end > start && (' ' == value->token[end - 1] || '\t' == value->token[end - 1])) {
+      end--;
+    }
+    if (end - start == len && 0 == strncasecmp((const char *)value->token + start, token, len)) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/* Is the value "chunked" and nothing else?
+ * We can't undo any other coding, so those are rejected.
+ */
+static int only_chunked(const HBytes *value) {
+  return has_token(value, "chunked") && NULL == memchr(value->token, ',', value->len);
+}
+
+/* Read a Content-Length value: 1*DIGIT, no sign, no spaces, no overflow.
+ * Returns 0 when it is not a valid length.
+ */
+static int content_length(const HBytes *value, size_t *len) {
+  if (0 == value->len) {
+    return 0;
+  }
+  size_t n = 0;
+  for (size_t i = 0; i < value->len; i++) {
+    uint8_t c = value->token[i];
+    if (c < '0' || c > '9') {
+      return 0;
+    }
+    if (n > (SIZE_MAX - (c - '0')) / 10) {
+      return 0;
+    }
+    n = n * 10 + (c - '0');
+  }
+  *len = n;
+  return 1;
+}
+
+
+/* What a pre-scan outcome means for the message
+ */
+message_status_t message_status_of(prescan_status_t status) {
+  switch (status) {
+  case PRESCAN_COMPLETE:       return MSG_OK;
+  case PRESCAN_INCOMPLETE:     return MSG_INCOMPLETE;
+  case PRESCAN_TOO_MANY_LINES:
+  case PRESCAN_LINE_TOO_LONG:
+  case PRESCAN_HEAD_TOO_LARGE: return MSG_TOO_LARGE;
+  default:                     return MSG_REJECT;
+  }
+}
+
+
+/* Parse a message.
+ * The pre-scan finds the end of the head and throws out junk first;
+ * the grammar then gets the complete head only, and must take all of it.
+ * The head parser must stop after the empty line (see post_head() and
+ * any_request_head()).
+ * Nothing has to end with the input: the message is framed by its head,
+ * so pipelined requests follow at input + msg->consumed.
+ */
+message_status_t parse_message(const HParser *head_p, const HParser *body_p, size_t max_body,
+			       const uint8_t *input, size_t length, message_t *msg) {
+  return parse_message__m(NULL, head_p, body_p, max_body, input, length, msg);
+}
+
+message_status_t parse_message__m(HAllocator *mm__, const HParser *head_p, const HParser *body_p, size_t max_body,
+				  const uint8_t *input, size_t length, message_t *msg) {
+  memset(msg, 0, sizeof(*msg));
+
+  prescan_t scan = PRESCAN_INIT;
+  size_t head_len;
+  prescan_status_t pre = prescan_head(&scan, input, length, &prescan_default_limits, &head_len);
+  if (PRESCAN_COMPLETE != pre) {
+    return message_status_of(pre);
+  }
+
+  msg->head_result = http_parse__m(mm__, head_p, input, head_len);
+  if (NULL == msg->head_result || (size_t)(msg->head_result->bit_length / 8) != head_len) {
+    return MSG_REJECT;
+  }
+  msg->head = msg->head_result->ast;
+  return parse_message_body__m(mm__, body_p, max_body, input, length, head_len, msg);
+}
+
+
+/* Parse the body of a message whose head is in msg already.
+ * There must be at most one Content-Length, or Transfer-Encoding: chunked,
+ * not both; without either there is no body.
+ * The body is checked against max_body before it gets parsed.
+ */
+message_status_t parse_message_body(const HParser *body_p, size_t max_body,
+				    const uint8_t *input, size_t length, size_t head_len,
+				    message_t *msg) {
+  return parse_message_body__m(NULL, body_p, max_body, input, length, head_len, msg);
+}
+
+static message_status_t parse_chunked_body(HAllocator *mm__, const HParser *body_p, size_t max_body,
+					   const uint8_t *input, size_t length, size_t head_len,
+					   chunked_t *framing, message_t *msg);
+
+message_status_t parse_message_body__m(HAllocator *mm__, const HParser *body_p, size_t max_body,
+				       const uint8_t *input, size_t length, size_t head_len,
+				       message_t *msg) {
+  return resume_message_body__m(mm__, body_p, max_body, input, length, head_len, NULL, msg);
+}
+
+message_status_t resume_message_body__m(HAllocator *mm__, const HParser *body_p, size_t max_body,
+					const uint8_t *input, size_t length, size_t head_len,
+					chunked_t *framing, message_t *msg) {
+  size_t body_len = 0;
+  size_t count = count_headers(msg->head, "Content-Length");
+  size_t encodings = count_headers(msg->head, "Transfer-Encoding");
+  if (count > 1 || (encodings && count) || encodings > 1) {
+    return MSG_REJECT; // conflicting lengths is how requests get smuggled
+  }
+  if (1 == encodings) {
+    if (!only_chunked(&find_header(msg->head, "Transfer-Encoding")->bytes)) {
+      return MSG_REJECT;
+    }
+    return parse_chunked_body(mm__, body_p, max_body, input, length, head_len, framing, msg);
+  }
+  if (1 == count && !content_length(&find_header(msg->head, "Content-Length")->bytes, &body_len)) {
+    return MSG_REJECT;
+  }
+  if (body_len > max_body) {
+    return MSG_TOO_LARGE;
+  }
+  if (body_len > length - head_len) {
+    return MSG_INCOMPLETE;
+  }
+
+  msg->body = input + head_len;
+  msg->body_len = body_len;
+  msg->consumed = head_len + body_len;
+  if (NULL == body_p) {
+    return MSG_OK;
+  }
+
+  msg->body_result = http_parse__m(mm__, body_p, msg->body, msg->body_len);
+  if (NULL == msg->body_result || (size_t)(msg->body_result->bit_length / 8) != msg->body_len) {
+    return MSG_REJECT; // the body parser must take all of the body
+  }
+  msg->value = msg->body_result->ast;
+  return MSG_OK;
+}
+
+
+/* Chunked bodies
+ * The first pass finds where the body ends. With the framing state of
+ * the caller it goes on where it left off and looks at new bytes only;
+ * without, it starts at the body every time. The second pass, once the
+ * body is all there, hands the payload to the body parser: a span
+ * at a time when its backend parses in chunks (LL(k), LALR), without a
+ * copy. Packrat, and the handler without a body parser, need the body
+ * in one piece, so then it is put together once.
+ */
+static message_status_t chunked_status(chunked_status_t status) {
+  switch (status) {
+  case CHUNKED_DONE:      return MSG_OK;
+  case CHUNKED_MORE:      return MSG_INCOMPLETE;
+  case CHUNKED_TOO_LARGE: return MSG_TOO_LARGE;
+  default:                return MSG_REJECT;
+  }
+}
+
+typedef struct {
+  HSuspendedParser *suspended;
+  int done;                   // the parser wants no more
+} chunk_parse_t;
+
+static int chunk_to_parser(void *user_data, const uint8_t *data, size_t len) {
+  chunk_parse_t *p = user_data;
+  if (p->done) {
+    return 0; // it stopped before the end of the body
+  }
+  p->done = h_parse_chunk(p->suspended, data, len);
+  return 1;
+}
+
+static int chunk_to_buffer(void *user_data, const uint8_t *data, size_t len) {
+  uint8_t **end = user_data;
+  memcpy(*end, data, len);
+  *end += len;
+  return 1;
+}
+
+static message_status_t parse_chunked_body(HAllocator *mm__, const HParser *body_p, size_t max_body,
+					   const uint8_t *input, size_t length, size_t head_len,
+					   chunked_t *framing, message_t *msg) {
+  chunked_t ch;
+  if (NULL == framing) {
+    chunked_init(&ch, max_body);
+    framing = &ch;
+  }
+  size_t seen = head_len + framing->used;
+  chunked_status_t status = chunked_feed(framing, input + seen, length - seen, NULL, NULL);
+  if (CHUNKED_DONE != status) {
+    return chunked_status(status);
+  }
+  size_t encoded_len = framing->used;
+  msg->body_len = framing->payload;
+  msg->consumed = head_len + encoded_len;
+
+  chunk_parse_t p = { NULL, 0 };
+  if (NULL != body_p) {
+    p.suspended = mm__ ? h_parse_start__m(mm__, body_p) : h_parse_start(body_p);
+  }
+  chunked_init(&ch, max_body);
+  if (NULL != p.suspended) {
+    status = chunked_feed(&ch, input + head_len, encoded_len, chunk_to_parser, &p);
+    msg->body_result = h_parse_finish(p.suspended);
+    if (CHUNKED_DONE != status) {
+      return MSG_REJECT;
+    }
+  } else {
+    uint8_t *buf = mm__ ? mm__->alloc(mm__, msg->body_len + 1) : malloc(msg->body_len + 1);
+    if (NULL == buf) {
+      return MSG_TOO_LARGE;
+    }
+    msg->decoded = buf;
+    msg->decoded_mm = mm__;
+    msg->body = buf;
+    chunked_feed(&ch, input + head_len, encoded_len, chunk_to_buffer, &buf);
+    if (NULL == body_p) {
+      return MSG_OK;
+    }
+    msg->body_result = http_parse__m(mm__, body_p, msg->body, msg->body_len);
+  }
+
+  if (NULL == msg->body_result || (size_t)(msg->body_result->bit_length / 8) != msg->body_len) {
+    return MSG_REJECT; // the body parser must take all of the body
+  }
+  msg->value = msg->body_result->ast;
+  return MSG_OK;
+}
+
+
+/* Can the connection carry another request after this one?
+ * HTTP/1.1 (the only version the grammar takes) keeps it open unless
+ * a Connection header says close, in any of them, among other tokens.
+ */
+int message_keep_alive(const message_t *msg) {
+  const HParsedToken *head = msg->head;
+  if (NULL != head && TT_header_index_t == (int)head->token_type) {
+    for (const header_entry_t *e = header_index_find(head->user, LEN("Connection")); e; e = e->next) {
+      if (TT_BYTES == e->value->token_type && has_token(&e->value->bytes, "close")) {
+	return 0;
+      }
+    }
+    return 1;
+  }
+  const HParsedToken *v = find_header(head, "Connection");
+  return NULL == v || !has_token(&v->bytes, "close");
+}
+
+
+/* Move the spans of a parsed head along with the buffer.
+ * The head points into the buffer (see http_parse()), but the body
+ * may arrive later and make the buffer grow.
+ */
+static void rebase_bytes(HBytes *b, uintptr_t from, size_t len, uint8_t *to) {
+  uintptr_t at = (uintptr_t)b->token;
+  if (at >= from && at < from + len) {
+    b->token = to + (at - from);
+  }
+}
+
+static void rebase_spans(HParsedToken *tok, uintptr_t from, size_t len, uint8_t *to) {
+  if (NULL == tok) {
+    return;
+  }
+  if (TT_BYTES == tok->token_type) {
+    rebase_bytes(&tok->bytes, from, len, to);
+  } else if (TT_SEQUENCE == tok->token_type) {
+    for (size_t i = 0; i < tok->seq->used; i++) {
+      rebase_spans(tok->seq->elements[i], from, len, to);
+    }
+  } else if (TT_header_index_t == (int)tok->token_type) {
+    // the index points at the tokens, moving them is enough
+    rebase_spans((HParsedToken *)((header_index_t *)tok->user)->headers, from, len, to);
+  } else if (TT_uri_t == (int)tok->token_type) {
+    uri_t *uri = tok->user;
+    rebase_bytes(&uri->path, from, len, to);
+    rebase_bytes(&uri->query, from, len, to);
+    for (size_t i = 0; i < uri->n_segments; i++) {
+      rebase_bytes(&uri->segments[i], from, len, to);
+    }
+    for (size_t i = 0; i < uri->n_params; i++) {
+      rebase_bytes(&uri->params[i].name, from, len, to);
+      rebase_bytes(&uri->params[i].value, from, len, to);
+    }
+  }
+}
+
+void message_rebase(message_t *msg, uintptr_t from, size_t len, uint8_t *to) {
+  rebase_spans((HParsedToken *)msg->head, from, len, to);
+}
+
+
+void message_free(message_t *msg) {
+  if (NULL != msg->head_result) {
+    h_parse_result_free(msg->head_result);
+  }
+  if (NULL != msg->body_result) {
+    h_parse_result_free(msg->body_result);
+  }
+  if (NULL != msg->decoded) {
+    if (NULL != msg->decoded_mm) {
+      msg->decoded_mm->free(msg->decoded_mm, msg->decoded);
+    } else {
+      free(msg->decoded);
+    }
+  }
+  memset(msg, 0, sizeof(*msg));
+}
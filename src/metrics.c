@@ -0,0 +1,296 @@
+// Hammering-webserver suite
+//
+// Metrics: parse latency, sizes and rejects, per entry point
+//
+// Every thread counts in tables of its own: a parse costs a few plain
+// increments, no lock and no atomic read-modify-write. Only the owner
+// writes its tables, with relaxed atomic stores so that a reader on
+// another thread sees whole counts. The tables of all threads hang in
+// a list; a thread takes the lock once, to join it.
+//
+// The histograms are in the manner of HdrHistogram: a value goes in a
+// bucket by its highest bit and the 4 bits after it, so the buckets
+// are never more than 1/16th apart, from a nanosecond to a minute and
+// from a byte to gigabytes alike.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#define _GNU_SOURCE // open_memstream
+
+#include <hammer/hammer.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "http.h"
+#include "governor.h"
+#include "metrics.h"
+
+typedef struct metrics_thread {
+  entry_metrics_t entries[ENTRY_COUNT];
+  struct metrics_thread *next;
+} metrics_thread_t;
+
+static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+static metrics_thread_t *threads = NULL;
+
+static __thread metrics_thread_t *this_thread = NULL;
+
+static const char *entry_names[ENTRY_COUNT] = {
+  [ENTRY_HTTP_REQUEST]  = "generic_http_request",
+  [ENTRY_POST]          = "post",
+  [ENTRY_HTTP_RESPONSE] = "http_response",
+  [ENTRY_JSON]          = "json",
+};
+
+static const char *reject_names[REJECT_COUNT] = {
+  [REJECT_NONE]       = "none",
+  [REJECT_START_LINE] = "start_line",
+  [REJECT_HEADER]     = "header",
+  [REJECT_BODY]       = "body",
+  [REJECT_JSON]       = "json",
+  [REJECT_LIMIT]      = "limit",
+};
+
+uint64_t metrics_clock(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+//----------------------------------------
+// Histograms
+
+static size_t bucket_of(uint64_t v) {
+  if (v < (1 << HIST_SUB_BITS)) {
+    return v;
+  }
+  unsigned top = 63 - __builtin_clzll(v);
+  unsigned shift = top - HIST_SUB_BITS;
+  return ((size_t)(shift + 1) << HIST_SUB_BITS) + ((v >> shift) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+// The highest value that goes in bucket b
+static uint64_t bucket_top(size_t b) {
+  if (b < (1 << HIST_SUB_BITS)) {
+    return b;
+  }
+  unsigned shift = (b >> HIST_SUB_BITS) - 1;
+  uint64_t low = ((uint64_t)(1 << HIST_SUB_BITS) + (b & ((1 << HIST_SUB_BITS) - 1))) << shift;
+  return low + (((uint64_t)1 << shift) - 1);
+}
+
+// Only the owner writes, so a load and a store do for an increment
+static inline void add(uint64_t *counter, uint64_t n) {
+  __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + n, __ATOMIC_RELAXED);
+}
+
+static void histogram_record(histogram_t *h, uint64_t v) {
+  add(&h->counts[bucket_of(v)], 1);
+  add(&h->count, 1);
+  add(&h->sum, v);
+}
+
+static void histogram_merge(histogram_t *into, const histogram_t *h) {
+  for (size_t b = 0; b < HIST_BUCKETS; b++) {
+    into->counts[b] += __atomic_load_n(&h->counts[b], __ATOMIC_RELAXED);
+  }
+  into->count += __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+  into->sum += __atomic_load_n(&h->sum, __ATOMIC_RELAXED);
+}
+
+uint64_t histogram_quantile(const histogram_t *h, double q) {
+  // counted while threads go on counting, h->count may be off by one
+  uint64_t total = 0;
+  for (size_t b = 0; b < HIST_BUCKETS; b++) {
+    total += h->counts[b];
+  }
+  if (0 == total) {
+    return 0;
+  }
+  uint64_t rank = (uint64_t)(q * total + 0.5);
+  rank = rank < 1 ? 1 : rank > total ? total : rank;
+  uint64_t seen = 0;
+  for (size_t b = 0; b < HIST_BUCKETS; b++) {
+    seen += h->counts[b];
+    if (seen >= rank) {
+      return bucket_top(b);
+    }
+  }
+  return bucket_top(HIST_BUCKETS - 1);
+}
+
+
+//----------------------------------------
+// Counting
+
+static metrics_thread_t *thread_tables(void) {
+  if (NULL != this_thread) {
+    return this_thread;
+  }
+  metrics_thread_t *t = calloc(1, sizeof(metrics_thread_t));
+  if (NULL == t) {
+    return NULL;
+  }
+  pthread_mutex_lock(&metrics_lock);
+  t->next = threads;
+  __atomic_store_n(&threads, t, __ATOMIC_RELEASE);
+  pthread_mutex_unlock(&metrics_lock);
+  this_thread = t;
+  return t;
+}
+
+void metrics_record(metric_entry_t entry, uint64_t latency_ns, size_t input_bytes,
+		    size_t arena_bytes, metric_reject_t reject) {
+  metrics_thread_t *t = thread_tables();
+  if (NULL == t) {
+    return;
+  }
+  entry_metrics_t *m = &t->entries[entry];
+  histogram_record(&m->latency_ns, latency_ns);
+  histogram_record(&m->input_bytes, input_bytes);
+  if (REJECT_NONE == reject) {
+    histogram_record(&m->arena_bytes, arena_bytes);
+  }
+  add(&m->rejects[reject], 1);
+}
+
+/* Which part of a rejected input is to blame?
+ * Only the start line gets looked at again, with the DFAs; past it we
+ * can't tell the headers from the body without parsing it all again.
+ */
+static metric_reject_t reject_reason(metric_entry_t entry, const uint8_t *input, size_t length) {
+  if (ENTRY_JSON == entry) {
+    return REJECT_JSON;
+  }
+  const uint8_t *lf = memchr(input, '\n', length);
+  size_t line_len = lf ? (size_t)(lf - input) + 1 : length;
+  HBytes a, b;
+  int line_ok = ENTRY_HTTP_RESPONSE == entry
+    ? scan_status_line(input, line_len, &a)
+    : scan_request_line(input, line_len, &a, &b);
+  return line_ok ? REJECT_HEADER : REJECT_START_LINE;
+}
+
+HParseResult *metered_parse(metric_entry_t entry, const HParser *parser, const uint8_t *input, size_t length) {
+  return metered_parse__m(NULL, entry, parser, input, length);
+}
+
+HParseResult *metered_parse__m(HAllocator *mm__, metric_entry_t entry, const HParser *parser,
+			       const uint8_t *input, size_t length) {
+  uint64_t start = metrics_clock();
+  HParseResult *res = http_parse__m(mm__, parser, input, length);
+  uint64_t latency = metrics_clock() - start;
+
+  size_t arena = 0;
+  metric_reject_t reject = REJECT_NONE;
+  if (NULL != res) {
+    HArenaStats stats;
+    h_allocator_stats(res->arena, &stats);
+    arena = stats.used + stats.wasted;
+  } else if (LIMIT_NONE != governor_exceeded()) {
+    reject = REJECT_LIMIT;
+  } else {
+    reject = reject_reason(entry, input, length);
+  }
+  metrics_record(entry, latency, length, arena, reject);
+  return res;
+}
+
+
+//----------------------------------------
+// Reading
+
+void metrics_merge(metric_entry_t entry, entry_metrics_t *out) {
+  memset(out, 0, sizeof(*out));
+  for (const metrics_thread_t *t = __atomic_load_n(&threads, __ATOMIC_ACQUIRE); NULL != t; t = t->next) {
+    const entry_metrics_t *m = &t->entries[entry];
+    histogram_merge(&out->latency_ns, &m->latency_ns);
+    histogram_merge(&out->input_bytes, &m->input_bytes);
+    histogram_merge(&out->arena_bytes, &m->arena_bytes);
+    for (size_t r = 0; r < REJECT_COUNT; r++) {
+      out->rejects[r] += __atomic_load_n(&m->rejects[r], __ATOMIC_RELAXED);
+    }
+  }
+}
+
+static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+// A summary for a histogram of each entry; scale turns units into the
+// base unit of the metric (seconds, bytes)
+static void export_summary(FILE *out, const char *name, const char *help, double scale,
+			   const entry_metrics_t *merged, size_t offset) {
+  fprintf(out, "# HELP %s %s\n", name, help);
+  fprintf(out, "# TYPE %s summary\n", name);
+  for (size_t e = 0; e < ENTRY_COUNT; e++) {
+    const histogram_t *h = (const histogram_t *)((const uint8_t *)&merged[e] + offset);
+    for (size_t q = 0; q < sizeof(quantiles) / sizeof(quantiles[0]); q++) {
+      if (0 == h->count) {
+	fprintf(out, "%s{entry=\"%s\",quantile=\"%g\"} NaN\n", name, entry_names[e], quantiles[q]);
+      } else {
+	fprintf(out, "%s{entry=\"%s\",quantile=\"%g\"} %.9g\n", name, entry_names[e], quantiles[q],
+		histogram_quantile(h, quantiles[q]) * scale);
+      }
+    }
+    fprintf(out, "%s_sum{entry=\"%s\"} %.9g\n", name, entry_names[e], h->sum * scale);
+    fprintf(out, "%s_count{entry=\"%s\"} %llu\n", name, entry_names[e], (unsigned long long)h->count);
+  }
+}
+
+void metrics_export(FILE *out) {
+  entry_metrics_t *merged = malloc(ENTRY_COUNT * sizeof(entry_metrics_t));
+  if (NULL == merged) {
+    return;
+  }
+  for (size_t e = 0; e < ENTRY_COUNT; e++) {
+    metrics_merge(e, &merged[e]);
+  }
+  export_summary(out, "hammering_parse_duration_seconds", "Time spent parsing, per entry point.",
+		 1e-9, merged, offsetof(entry_metrics_t, latency_ns));
+  export_summary(out, "hammering_parse_input_bytes", "Size of the parsed input.",
+		 1, merged, offsetof(entry_metrics_t, input_bytes));
+  export_summary(out, "hammering_parse_arena_bytes", "Arena bytes an accepted parse used.",
+		 1, merged, offsetof(entry_metrics_t, arena_bytes));
+
+  fprintf(out, "# HELP hammering_parse_rejects_total Rejected parses, by the part of the grammar that failed.\n");
+  fprintf(out, "# TYPE hammering_parse_rejects_total counter\n");
+  for (size_t e = 0; e < ENTRY_COUNT; e++) {
+    for (size_t r = REJECT_NONE + 1; r < REJECT_COUNT; r++) {
+      fprintf(out, "hammering_parse_rejects_total{entry=\"%s\",reason=\"%s\"} %llu\n",
+	      entry_names[e], reject_names[r], (unsigned long long)merged[e].rejects[r]);
+    }
+  }
+  free(merged);
+}
+
+// The last answer of this thread; the server copies it before the next
+static __thread char *export_text = NULL;
+
+void metrics_handler(const message_t *msg, response_t *res, void *user_data) {
+  free(export_text);
+  export_text = NULL;
+  size_t len = 0;
+  FILE *out = open_memstream(&export_text, &len);
+  if (NULL == out) {
+    res->status = 500;
+    return;
+  }
+  metrics_export(out);
+  fclose(out);
+  res->content_type = "text/plain; version=0.0.4";
+  res->body = (const uint8_t *)export_text;
+  res->body_len = len;
+}
+
+void metrics_reset(void) {
+  pthread_mutex_lock(&metrics_lock);
+  for (metrics_thread_t *t = threads; NULL != t; t = t->next) {
+    memset(t->entries, 0, sizeof(t->entries));
+  }
+  pthread_mutex_unlock(&metrics_lock);
+}
@@ -0,0 +1,126 @@
+// Hammering-webserver suite
+//
+// Pre-scan of the head before the grammar runs
+//
+// Most bytes of a head are plain ascii (32-126). We skip over those a
+// vector at a time and only look at the others: tab, CR, LF, and
+// anything else, which is never allowed in a head (see ascii() and
+// reason_text()). This finds the empty line that ends the head and
+// throws out junk in a few ns per KB, so the grammar only ever runs on
+// a complete head that has a chance to parse.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <stddef.h>
+#include <stdint.h>
+#include "prescan.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+const prescan_limits_t prescan_default_limits = {
+  DEFAULT_MAX_HEAD,
+  DEFAULT_MAX_LINES,
+  DEFAULT_MAX_LINE,
+};
+
+
+// Is c outside 32-126?
+static inline int special(uint8_t c) {
+  return c < 0x20 || c > 0x7e;
+}
+
+/* Find the next byte outside 32-126, from i on.
+ * Returns length when there is none.
+ * Signed compares: 0x80-0xff are negative, so (c < 0x20) catches them too.
+ */
+static size_t next_special(const uint8_t *input, size_t i, size_t length) {
+#if defined(__AVX2__)
+  const __m256i space = _mm256_set1_epi8(0x20);
+  const __m256i del = _mm256_set1_epi8(0x7f);
+  for (; i + 32 <= length; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(input + i));
+    __m256i m = _mm256_or_si256(_mm256_cmpgt_epi8(space, x), _mm256_cmpeq_epi8(x, del));
+    uint32_t mask = _mm256_movemask_epi8(m);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#elif defined(__SSE2__)
+  const __m128i space = _mm_set1_epi8(0x20);
+  const __m128i del = _mm_set1_epi8(0x7f);
+  for (; i + 16 <= length; i += 16) {
+    __m128i x = _mm_loadu_si128((const __m128i *)(input + i));
+    __m128i m = _mm_or_si128(_mm_cmplt_epi8(x, space), _mm_cmpeq_epi8(x, del));
+    uint32_t mask = _mm_movemask_epi8(m);
+    if (mask) {
+      return i + __builtin_ctz(mask);
+    }
+  }
+#endif
+  for (; i < length; i++) {
+    if (special(input[i])) {
+      return i;
+    }
+  }
+  return length;
+}
+
+
+/* Scan for the end of the head.
+ * Every line ends in CRLF; the first empty line ends the head.
+ * A CR at the very end of the input waits for the next call.
+ */
+prescan_status_t prescan_head(prescan_t *scan, const uint8_t *input, size_t length,
+			      const prescan_limits_t *limits, size_t *head_len) {
+  size_t i = scan->pos;
+  for (;;) {
+    i = next_special(input, i, length);
+    if (i - scan->line_start > limits->max_line) {
+      return PRESCAN_LINE_TOO_LONG;
+    }
+    if (i >= length) {
+      break;
+    }
+    switch (input[i]) {
+    case '\t':
+      i++;
+      continue;
+    case '\r':
+      if (i + 1 >= length) {
+	goto more;
+      }
+      if ('\n' != input[i + 1]) {
+	return PRESCAN_BARE_CR;
+      }
+      if (i == scan->line_start) {
+	if (i + 2 > limits->max_head) {
+	  return PRESCAN_HEAD_TOO_LARGE;
+	}
+	scan->pos = i + 2;
+	*head_len = i + 2;
+	return PRESCAN_COMPLETE;
+      }
+      if (++scan->lines > limits->max_lines) {
+	return PRESCAN_TOO_MANY_LINES;
+      }
+      i += 2;
+      scan->line_start = i;
+      continue;
+    case '\n':
+      return PRESCAN_BARE_LF;
+    default:
+      return PRESCAN_BAD_BYTE;
+    }
+  }
+ more:
+  scan->pos = i;
+  if (length > limits->max_head) {
+    return PRESCAN_HEAD_TOO_LARGE;
+  }
+  return PRESCAN_INCOMPLETE;
+}
@@ -0,0 +1,311 @@
+// Hammering-webserver suite
+//
+// Rule profiler: what every named rule of the grammar costs
+//
+// profiled() wraps a rule in gates, the way limited() does:
+//
+//   choice(action(right(enter, rule), leave), fail)
+//
+// enter pushes a frame on a stack of this thread and notes the ticks;
+// leave sees the rule matched and how many bytes; fail sees it didn't,
+// pops, and fails in turn. Each wrapper has gates of its own, so
+// packrat never answers them from its memo tables at the wrong place.
+//
+// Every thread counts in its own tables, nothing is shared while
+// parsing. Besides the counts per rule it keeps a calling context tree:
+// a node per distinct stack of rules, with the ticks spent there. That
+// is what the folded stacks come from.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <hammer/glue.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include "profile.h"
+
+typedef struct {
+  uint64_t calls;
+  uint64_t ok;
+  uint64_t failed;
+  uint64_t bytes;         // matched
+  uint64_t backtracked;   // matched below, then thrown away
+  uint64_t ticks;         // from enter to leave, nested calls included
+  uint64_t self_ticks;    // without the named rules below
+} rule_stats_t;
+
+typedef struct {
+  size_t rule;
+  size_t node;
+  uint64_t start;
+  uint64_t child_ticks;
+  uint64_t child_bytes;
+} frame_t;
+
+// Calling context tree; node 0 is the root, above the outermost rule
+typedef struct {
+  size_t rule;
+  size_t parent;
+  size_t first_child;     // 0 for none: the root is nobody's child
+  size_t next_sibling;
+  uint64_t self_ticks;
+} cct_node_t;
+
+typedef struct profile_thread {
+  rule_stats_t rules[MAX_PROFILED_RULES];
+  frame_t stack[PROFILE_MAX_DEPTH];
+  size_t depth;           // may go past PROFILE_MAX_DEPTH, see enter()
+  cct_node_t *nodes;
+  size_t n_nodes, nodes_cap;
+  struct profile_thread *next;
+} profile_thread_t;
+
+static pthread_mutex_t profile_lock = PTHREAD_MUTEX_INITIALIZER;
+static const char *rule_names[MAX_PROFILED_RULES];
+static size_t n_rules = 0;
+static profile_thread_t *threads = NULL;
+
+static __thread profile_thread_t *this_thread = NULL;
+
+static inline uint64_t ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+static profile_thread_t *thread_tables(void) {
+  if (NULL != this_thread) {
+    return this_thread;
+  }
+  profile_thread_t *t = calloc(1, sizeof(profile_thread_t));
+  if (NULL == t) {
+    return NULL;
+  }
+  t->nodes_cap = 64;
+  t->nodes = calloc(t->nodes_cap, sizeof(cct_node_t));
+  if (NULL == t->nodes) {
+    free(t);
+    return NULL;
+  }
+  t->n_nodes = 1;
+  pthread_mutex_lock(&profile_lock);
+  t->next = threads;
+  threads = t;
+  pthread_mutex_unlock(&profile_lock);
+  this_thread = t;
+  return t;
+}
+
+// The node for rule below parent; the parent when out of memory
+static size_t cct_child(profile_thread_t *t, size_t parent, size_t rule) {
+  size_t n = t->nodes[parent].first_child;
+  for (; 0 != n; n = t->nodes[n].next_sibling) {
+    if (t->nodes[n].rule == rule) {
+      return n;
+    }
+  }
+  if (t->n_nodes == t->nodes_cap) {
+    cct_node_t *nodes = realloc(t->nodes, 2 * t->nodes_cap * sizeof(cct_node_t));
+    if (NULL == nodes) {
+      return parent;
+    }
+    t->nodes = nodes;
+    t->nodes_cap *= 2;
+  }
+  n = t->n_nodes++;
+  t->nodes[n] = (cct_node_t){ rule, parent, 0, t->nodes[parent].first_child, 0 };
+  t->nodes[parent].first_child = n;
+  return n;
+}
+
+
+//----------------------------------------
+// Gates
+
+// attr_bool only asks about parses with a token
+static HParsedToken *act_mark(const HParseResult *p, void *user_data) {
+  return H_MAKE_UINT(0);
+}
+
+static bool enter(HParseResult *p, void *user_data) {
+  profile_thread_t *t = thread_tables();
+  if (NULL == t) {
+    return true;
+  }
+  // too deep: count the depth, so leave and fail stay in step
+  if (t->depth++ >= PROFILE_MAX_DEPTH) {
+    return true;
+  }
+  size_t rule = (size_t)user_data;
+  size_t parent = t->depth > 1 ? t->stack[t->depth - 2].node : 0;
+  frame_t *f = &t->stack[t->depth - 1];
+  f->rule = rule;
+  f->node = cct_child(t, parent, rule);
+  f->child_ticks = 0;
+  f->child_bytes = 0;
+  t->rules[rule].calls++;
+  f->start = ticks();
+  return true;
+}
+
+// Pop the frame of a rule that is done; its ticks go up the stack
+static frame_t *pop(profile_thread_t *t, uint64_t now) {
+  if (NULL == t || 0 == t->depth || t->depth-- > PROFILE_MAX_DEPTH) {
+    return NULL;
+  }
+  frame_t *f = &t->stack[t->depth];
+  uint64_t total = now - f->start;
+  uint64_t self = total > f->child_ticks ? total - f->child_ticks : 0;
+  t->rules[f->rule].ticks += total;
+  t->rules[f->rule].self_ticks += self;
+  t->nodes[f->node].self_ticks += self;
+  if (t->depth > 0) {
+    t->stack[t->depth - 1].child_ticks += total;
+  }
+  return f;
+}
+
+static HParsedToken *act_leave(const HParseResult *p, void *user_data) {
+  profile_thread_t *t = this_thread;
+  frame_t *f = pop(t, ticks());
+  if (NULL != f) {
+    size_t bytes = p->bit_length / 8;
+    t->rules[f->rule].ok++;
+    t->rules[f->rule].bytes += bytes;
+    if (t->depth > 0) {
+      t->stack[t->depth - 1].child_bytes += bytes;
+    }
+  }
+  return (HParsedToken *)p->ast;
+}
+
+static bool fail(HParseResult *p, void *user_data) {
+  profile_thread_t *t = this_thread;
+  frame_t *f = pop(t, ticks());
+  if (NULL != f) {
+    t->rules[f->rule].failed++;
+    t->rules[f->rule].backtracked += f->child_bytes;
+  }
+  return false;
+}
+
+static size_t rule_id(const char *name) {
+  pthread_mutex_lock(&profile_lock);
+  size_t id = 0;
+  while (id < n_rules && 0 != strcmp(rule_names[id], name)) {
+    id++;
+  }
+  if (id == n_rules && n_rules < MAX_PROFILED_RULES) {
+    rule_names[n_rules++] = name;
+  }
+  pthread_mutex_unlock(&profile_lock);
+  return id;
+}
+
+HParser *profiled(const char *name, const HParser *p) {
+  size_t id = rule_id(name);
+  if (id == MAX_PROFILED_RULES) {
+    return (HParser *)p;
+  }
+  HParser *enter_gate = h_attr_bool(h_action(h_epsilon_p(), act_mark, NULL), enter, (void *)id);
+  HParser *fail_gate = h_attr_bool(h_action(h_epsilon_p(), act_mark, NULL), fail, (void *)id);
+  return h_choice(h_action(h_right(enter_gate, p), act_leave, NULL),
+		  fail_gate,
+		  NULL);
+}
+
+
+//----------------------------------------
+// Reports
+
+static rule_stats_t totals[MAX_PROFILED_RULES];
+static size_t order[MAX_PROFILED_RULES];
+
+static int by_self_ticks(const void *a, const void *b) {
+  uint64_t x = totals[*(const size_t *)a].self_ticks;
+  uint64_t y = totals[*(const size_t *)b].self_ticks;
+  return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void profile_report(FILE *out) {
+  pthread_mutex_lock(&profile_lock);
+  memset(totals, 0, sizeof(totals));
+  for (const profile_thread_t *t = threads; NULL != t; t = t->next) {
+    for (size_t r = 0; r < n_rules; r++) {
+      totals[r].calls       += t->rules[r].calls;
+      totals[r].ok          += t->rules[r].ok;
+      totals[r].failed      += t->rules[r].failed;
+      totals[r].bytes       += t->rules[r].bytes;
+      totals[r].backtracked += t->rules[r].backtracked;
+      totals[r].ticks       += t->rules[r].ticks;
+      totals[r].self_ticks  += t->rules[r].self_ticks;
+    }
+  }
+  for (size_t r = 0; r < n_rules; r++) {
+    order[r] = r;
+  }
+  qsort(order, n_rules, sizeof(size_t), by_self_ticks);
+
+  fprintf(out, "%-28s %12s %12s %12s %14s %14s %16s %16s\n",
+	  "rule", "calls", "ok", "failed", "bytes", "backtracked", "ticks", "self ticks");
+  for (size_t i = 0; i < n_rules; i++) {
+    const rule_stats_t *s = &totals[order[i]];
+    if (0 == s->calls) {
+      continue;
+    }
+    fprintf(out, "%-28s %12llu %12llu %12llu %14llu %14llu %16llu %16llu\n", rule_names[order[i]],
+	    (unsigned long long)s->calls, (unsigned long long)s->ok, (unsigned long long)s->failed,
+	    (unsigned long long)s->bytes, (unsigned long long)s->backtracked,
+	    (unsigned long long)s->ticks, (unsigned long long)s->self_ticks);
+  }
+  pthread_mutex_unlock(&profile_lock);
+}
+
+// Print the stack of node, outermost rule first
+static void print_stack(FILE *out, const profile_thread_t *t, size_t node) {
+  if (0 == node) {
+    return;
+  }
+  print_stack(out, t, t->nodes[node].parent);
+  if (0 != t->nodes[node].parent) {
+    fputc(';', out);
+  }
+  fputs(rule_names[t->nodes[node].rule], out);
+}
+
+void profile_folded(FILE *out) {
+  pthread_mutex_lock(&profile_lock);
+  for (const profile_thread_t *t = threads; NULL != t; t = t->next) {
+    for (size_t n = 1; n < t->n_nodes; n++) {
+      if (0 == t->nodes[n].self_ticks) {
+	continue;
+      }
+      print_stack(out, t, n);
+      fprintf(out, " %llu\n", (unsigned long long)t->nodes[n].self_ticks);
+    }
+  }
+  pthread_mutex_unlock(&profile_lock);
+}
+
+void profile_reset(void) {
+  pthread_mutex_lock(&profile_lock);
+  for (profile_thread_t *t = threads; NULL != t; t = t->next) {
+    memset(t->rules, 0, sizeof(t->rules));
+    for (size_t n = 0; n < t->n_nodes; n++) {
+      t->nodes[n].self_ticks = 0;
+    }
+  }
+  pthread_mutex_unlock(&profile_lock);
+}
@@ -0,0 +1,223 @@
+// Hammering-webserver suite
+//
+// Router: method and path to a route, in a radix tree
+//
+// With a grammar per endpoint, finding the endpoint means trying them
+// all: an h_choice re-parses the request line and the headers for every
+// route until one takes it. Instead the server parses the request line
+// once and looks up the method and the uri here; only the route found
+// runs its header and body parsers.
+//
+// There are a few methods, so each gets a tree of its own. A node holds
+// the bytes all paths below it share, its children differ in their
+// first byte and are kept sorted on it. A lookup compares every byte of
+// the uri once, whatever the number of routes.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http.h"
+#include "router.h"
+
+typedef struct node {
+  uint8_t *prefix;
+  size_t len;
+  const void *value;         // NULL when no path ends here
+  struct node **children;    // sorted on prefix[0]
+  size_t n_children;
+} node_t;
+
+typedef struct {
+  char *method;
+  node_t *root;
+} method_tree_t;
+
+struct router {
+  method_tree_t *methods;
+  size_t n_methods;
+};
+
+
+static node_t *node_new(const uint8_t *prefix, size_t len) {
+  node_t *node = calloc(1, sizeof(node_t));
+  if (NULL == node) {
+    return NULL;
+  }
+  node->prefix = malloc(len ? len : 1);
+  if (NULL == node->prefix) {
+    free(node);
+    return NULL;
+  }
+  memcpy(node->prefix, prefix, len);
+  node->len = len;
+  return node;
+}
+
+static void node_free(node_t *node) {
+  for (size_t i = 0; i < node->n_children; i++) {
+    node_free(node->children[i]);
+  }
+  free(node->children);
+  free(node->prefix);
+  free(node);
+}
+
+// The child that starts with c, or where it goes
+static size_t child_index(const node_t *node, uint8_t c) {
+  size_t lo = 0, hi = node->n_children;
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (node->children[mid]->prefix[0] < c) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+static node_t *find_child(const node_t *node, uint8_t c) {
+  size_t i = child_index(node, c);
+  return i < node->n_children && node->children[i]->prefix[0] == c ? node->children[i] : NULL;
+}
+
+static int add_child(node_t *node, node_t *child) {
+  size_t i = child_index(node, child->prefix[0]);
+  node_t **children = realloc(node->children, (node->n_children + 1) * sizeof(node_t *));
+  if (NULL == children) {
+    return 0;
+  }
+  memmove(children + i + 1, children + i, (node->n_children - i) * sizeof(node_t *));
+  children[i] = child;
+  node->children = children;
+  node->n_children++;
+  return 1;
+}
+
+/* Cut node after len bytes: what follows moves to a new child.
+ */
+static int split(node_t *node, size_t len) {
+  node_t *tail = node_new(node->prefix + len, node->len - len);
+  node_t **children = malloc(sizeof(node_t *));
+  if (NULL == tail || NULL == children) {
+    free(children);
+    if (NULL != tail) {
+      node_free(tail);
+    }
+    return 0;
+  }
+  tail->value = node->value;
+  tail->children = node->children;
+  tail->n_children = node->n_children;
+  children[0] = tail;
+  node->children = children;
+  node->n_children = 1;
+  node->value = NULL;
+  node->len = len;
+  return 1;
+}
+
+static int insert(node_t *node, const uint8_t *key, size_t len, const void *value) {
+  for (;;) {
+    if (0 == len) {
+      if (NULL != node->value) {
+	return 0;
+      }
+      node->value = value;
+      return 1;
+    }
+    node_t *child = find_child(node, key[0]);
+    if (NULL == child) {
+      child = node_new(key, len);
+      if (NULL == child) {
+	return 0;
+      }
+      child->value = value;
+      if (!add_child(node, child)) {
+	node_free(child);
+	return 0;
+      }
+      return 1;
+    }
+    size_t common = 0;
+    while (common < child->len && common < len && child->prefix[common] == key[common]) {
+      common++;
+    }
+    if (common < child->len && !split(child, common)) {
+      return 0;
+    }
+    node = child;
+    key += common;
+    len -= common;
+  }
+}
+
+
+router_t *router_new(void) {
+  return calloc(1, sizeof(router_t));
+}
+
+static method_tree_t *find_method(const router_t *router, const uint8_t *method, size_t len) {
+  for (size_t i = 0; i < router->n_methods; i++) {
+    if (strlen(router->methods[i].method) == len && 0 == memcmp(router->methods[i].method, method, len)) {
+      return &router->methods[i];
+    }
+  }
+  return NULL;
+}
+
+int router_add(router_t *router, const char *method, const char *path, const void *value) {
+  assert(post_url_valid((uint8_t *)path));
+  assert(NULL != value);
+  method_tree_t *tree = find_method(router, (const uint8_t *)method, strlen(method));
+  if (NULL == tree) {
+    method_tree_t *methods = realloc(router->methods, (router->n_methods + 1) * sizeof(method_tree_t));
+    if (NULL == methods) {
+      return 0;
+    }
+    router->methods = methods;
+    tree = &methods[router->n_methods];
+    tree->method = strdup(method);
+    tree->root = node_new((const uint8_t *)"", 0);
+    if (NULL == tree->method || NULL == tree->root) {
+      free(tree->method);
+      if (NULL != tree->root) {
+	node_free(tree->root);
+      }
+      return 0;
+    }
+    router->n_methods++;
+  }
+  return insert(tree->root, (const uint8_t *)path, strlen(path), value);
+}
+
+const void *router_find(const router_t *router, const uint8_t *method, size_t method_len,
+			const uint8_t *uri, size_t uri_len) {
+  const method_tree_t *tree = find_method(router, method, method_len);
+  const node_t *node = tree ? tree->root : NULL;
+  while (NULL != node) {
+    if (uri_len < node->len || 0 != memcmp(node->prefix, uri, node->len)) {
+      return NULL;
+    }
+    uri += node->len;
+    uri_len -= node->len;
+    if (0 == uri_len) {
+      return node->value;
+    }
+    node = find_child(node, uri[0]);
+  }
+  return NULL;
+}
+
+void router_free(router_t *router) {
+  for (size_t i = 0; i < router->n_methods; i++) {
+    free(router->methods[i].method);
+    node_free(router->methods[i].root);
+  }
+  free(router->methods);
+  free(router);
+}
@@ -0,0 +1,379 @@
+// Hammering-webserver suite
+//
+// Streaming JSON: callbacks per value, no tree
+//
+// For bodies too big to keep as tokens. This is the grammar of
+// init_json_parser() as a push state machine: one byte at a time, so
+// the input can come in pieces of any size, and memory is what
+// json_sax_init() allocates, however long the input is.
+//
+// Keep the two in step. The test suite feeds both the same documents
+// and checks they agree.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "sax.h"
+
+typedef enum {
+  SAX_VALUE,            // a value must come: at the start, after : and after , in an array
+  SAX_VALUE_OR_END,     // after [
+  SAX_KEY_OR_END,       // after {
+  SAX_KEY,              // after , in an object
+  SAX_COLON,
+  SAX_AFTER_VALUE,      // , or the close of the object or array
+  SAX_STRING,
+  SAX_STRING_ESCAPE,    // after the backslash
+  SAX_STRING_HEX,       // in the XXXX of \uXXXX
+  SAX_LOW_BACKSLASH,    // a high surrogate needs \u and the low one
+  SAX_LOW_U,
+  SAX_NUMBER,
+  SAX_LITERAL,
+  SAX_END,              // the value is complete
+} sax_state_t;
+
+#define IN_OBJECT 1
+#define IN_ARRAY  0
+
+int json_sax_init(json_sax_t *sax, const json_sax_callbacks_t *cb, void *user_data,
+		  size_t max_depth, size_t max_token) {
+  memset(sax, 0, sizeof(*sax));
+  sax->cb = cb;
+  sax->user_data = user_data;
+  sax->max_depth = max_depth;
+  sax->max_token = max_token;
+  sax->status = JSON_SAX_MORE;
+  sax->state = SAX_VALUE;
+  sax->stack = malloc(max_depth ? max_depth : 1);
+  sax->buf = malloc(max_token ? max_token : 1);
+  if (NULL == sax->stack || NULL == sax->buf) {
+    json_sax_free(sax);
+    return 0;
+  }
+  return 1;
+}
+
+void json_sax_free(json_sax_t *sax) {
+  free(sax->stack);
+  free(sax->buf);
+  sax->stack = NULL;
+  sax->buf = NULL;
+}
+
+
+//----------------------------------------
+// Helpers
+
+static int is_ws(uint8_t c) {
+  return ' ' == c || '\r' == c || '\n' == c || '\t' == c;
+}
+
+// The bytes the grammar allows white space around
+static int is_structural(uint8_t c) {
+  return '{' == c || '}' == c || '[' == c || ']' == c || ':' == c || ',' == c;
+}
+
+static int is_hex(uint8_t c) {
+  return (c >= '0' && c <= '9') || ((c | 0x20) >= 'a' && (c | 0x20) <= 'f');
+}
+
+static int hex_value(uint8_t c) {
+  return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+}
+
+static int is_number_char(uint8_t c) {
+  return (c >= '0' && c <= '9') || '-' == c || '+' == c || '.' == c || 'e' == c || 'E' == c;
+}
+
+#define CALL(sax, fn, ...) \
+  (NULL == (sax)->cb->fn || (sax)->cb->fn((sax)->user_data, ##__VA_ARGS__))
+
+static json_sax_status_t stop(json_sax_t *sax, json_sax_status_t status) {
+  sax->status = status;
+  return status;
+}
+
+static int push_byte(json_sax_t *sax, uint8_t c) {
+  if (sax->len >= sax->max_token) {
+    return 0;
+  }
+  sax->buf[sax->len++] = c;
+  return 1;
+}
+
+// A scalar is complete: what comes next?
+static void after_value(json_sax_t *sax) {
+  sax->state = sax->depth ? SAX_AFTER_VALUE : SAX_END;
+}
+
+static json_sax_status_t open_container(json_sax_t *sax, int kind) {
+  if (sax->depth == sax->max_depth) {
+    return stop(sax, JSON_SAX_TOO_LARGE);
+  }
+  sax->stack[sax->depth++] = kind;
+  if (IN_OBJECT == kind) {
+    sax->state = SAX_KEY_OR_END;
+    return CALL(sax, start_object) ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+  }
+  sax->state = SAX_VALUE_OR_END;
+  return CALL(sax, start_array) ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+}
+
+static json_sax_status_t close_container(json_sax_t *sax, int kind) {
+  if (0 == sax->depth || kind != sax->stack[sax->depth - 1]) {
+    return stop(sax, JSON_SAX_REJECT);
+  }
+  sax->depth--;
+  after_value(sax);
+  int go_on = IN_OBJECT == kind ? CALL(sax, end_object) : CALL(sax, end_array);
+  return go_on ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+}
+
+static json_sax_status_t end_string(json_sax_t *sax) {
+  size_t len = json_unescape(sax->buf, sax->len, sax->buf);
+  int go_on;
+  if (sax->is_key) {
+    sax->state = SAX_COLON;
+    go_on = CALL(sax, key, sax->buf, len);
+  } else {
+    after_value(sax);
+    go_on = CALL(sax, string, sax->buf, len);
+  }
+  return go_on ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+}
+
+static json_sax_status_t end_number(json_sax_t *sax) {
+  json_number_t n;
+  if (!json_decode_number(sax->buf, sax->len, &n)) {
+    return stop(sax, JSON_SAX_REJECT);
+  }
+  after_value(sax);
+  return CALL(sax, number, &n) ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+}
+
+static json_sax_status_t end_literal(json_sax_t *sax) {
+  after_value(sax);
+  int go_on;
+  switch (sax->literal[0]) {
+  case 't': go_on = CALL(sax, boolean, 1); break;
+  case 'f': go_on = CALL(sax, boolean, 0); break;
+  default:  go_on = CALL(sax, null);       break;
+  }
+  return go_on ? JSON_SAX_MORE : stop(sax, JSON_SAX_STOPPED);
+}
+
+// The first byte of a value
+static json_sax_status_t start_value(json_sax_t *sax, uint8_t c) {
+  switch (c) {
+  case '{': return open_container(sax, IN_OBJECT);
+  case '[': return open_container(sax, IN_ARRAY);
+  case '"':
+    sax->state = SAX_STRING;
+    sax->is_key = 0;
+    sax->len = 0;
+    return JSON_SAX_MORE;
+  case 't': sax->literal = "true";  break;
+  case 'f': sax->literal = "false"; break;
+  case 'n': sax->literal = "null";  break;
+  default:
+    if ('-' == c || (c >= '0' && c <= '9')) {
+      sax->state = SAX_NUMBER;
+      sax->len = 0;
+      push_byte(sax, c);
+      return JSON_SAX_MORE;
+    }
+    return stop(sax, JSON_SAX_REJECT);
+  }
+  sax->state = SAX_LITERAL;
+  sax->literal_pos = 1;
+  return JSON_SAX_MORE;
+}
+
+
+//----------------------------------------
+// The state machine
+
+// A byte inside a string
+static json_sax_status_t string_byte(json_sax_t *sax, uint8_t c) {
+  switch (sax->state) {
+  case SAX_STRING:
+    if ('"' == c) {
+      return end_string(sax);
+    }
+    if (c < 0x20) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    if ('\\' == c) {
+      sax->state = SAX_STRING_ESCAPE;
+    }
+    break;
+
+  case SAX_STRING_ESCAPE:
+    if ('u' == c) {
+      sax->state = SAX_STRING_HEX;
+      sax->hex_pos = 0;
+      sax->hex_high = sax->hex_low = 0;
+    } else if (NULL != memchr("\"\\/bfnrt", c, 8)) {
+      sax->state = SAX_STRING;
+    } else {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    break;
+
+  case SAX_STRING_HEX:
+    // as the grammar: no surrogates but a high one followed by a low one
+    if (!is_hex(c)) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    if (0 == sax->hex_pos) {
+      sax->hex_d = 'd' == (c | 0x20);
+      if (sax->hex_low && !sax->hex_d) {
+	return stop(sax, JSON_SAX_REJECT);
+      }
+    } else if (1 == sax->hex_pos && sax->hex_d) {
+      int v = hex_value(c);
+      if (sax->hex_low ? v < 0xC : v >= 0xC) {
+	return stop(sax, JSON_SAX_REJECT);
+      }
+      sax->hex_high = !sax->hex_low && v >= 0x8;
+    }
+    if (4 == ++sax->hex_pos) {
+      sax->state = sax->hex_high ? SAX_LOW_BACKSLASH : SAX_STRING;
+    }
+    break;
+
+  case SAX_LOW_BACKSLASH:
+    if ('\\' != c) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    sax->state = SAX_LOW_U;
+    break;
+
+  case SAX_LOW_U:
+    if ('u' != c) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    sax->state = SAX_STRING_HEX;
+    sax->hex_pos = 0;
+    sax->hex_high = 0;
+    sax->hex_low = 1;
+    break;
+  }
+  return push_byte(sax, c) ? JSON_SAX_MORE : stop(sax, JSON_SAX_TOO_LARGE);
+}
+
+// A byte outside strings, numbers and literals
+static json_sax_status_t structure_byte(json_sax_t *sax, uint8_t c) {
+  // white space only next to {}[]:, as the grammar has it
+  if (is_ws(c)) {
+    if (!sax->last_structural) {
+      sax->ws_pending = 1;
+    }
+    return JSON_SAX_MORE;
+  }
+  if (sax->ws_pending && !is_structural(c)) {
+    return stop(sax, JSON_SAX_REJECT);
+  }
+  sax->ws_pending = 0;
+  sax->last_structural = is_structural(c);
+
+  switch (sax->state) {
+  case SAX_VALUE_OR_END:
+    if (']' == c) {
+      return close_container(sax, IN_ARRAY);
+    }
+    return start_value(sax, c);
+
+  case SAX_VALUE:
+    return start_value(sax, c);
+
+  case SAX_KEY_OR_END:
+    if ('}' == c) {
+      return close_container(sax, IN_OBJECT);
+    }
+    // fall through
+  case SAX_KEY:
+    if ('"' != c) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    sax->state = SAX_STRING;
+    sax->is_key = 1;
+    sax->len = 0;
+    return JSON_SAX_MORE;
+
+  case SAX_COLON:
+    if (':' != c) {
+      return stop(sax, JSON_SAX_REJECT);
+    }
+    sax->state = SAX_VALUE;
+    return JSON_SAX_MORE;
+
+  case SAX_AFTER_VALUE:
+    switch (c) {
+    case ',': sax->state = IN_OBJECT == sax->stack[sax->depth - 1] ? SAX_KEY : SAX_VALUE; return JSON_SAX_MORE;
+    case '}': return close_container(sax, IN_OBJECT);
+    case ']': return close_container(sax, IN_ARRAY);
+    default:  return stop(sax, JSON_SAX_REJECT);
+    }
+
+  default: // SAX_END: one value only
+    return stop(sax, JSON_SAX_REJECT);
+  }
+}
+
+json_sax_status_t json_sax_feed(json_sax_t *sax, const uint8_t *input, size_t length) {
+  for (size_t i = 0; i < length && JSON_SAX_MORE == sax->status; i++) {
+    uint8_t c = input[i];
+    switch (sax->state) {
+    case SAX_STRING:
+    case SAX_STRING_ESCAPE:
+    case SAX_STRING_HEX:
+    case SAX_LOW_BACKSLASH:
+    case SAX_LOW_U:
+      string_byte(sax, c);
+      break;
+
+    case SAX_NUMBER:
+      if (is_number_char(c)) {
+	if (!push_byte(sax, c)) {
+	  stop(sax, JSON_SAX_TOO_LARGE);
+	}
+	break;
+      }
+      // the number ends here, c belongs to what follows
+      if (JSON_SAX_MORE == end_number(sax)) {
+	structure_byte(sax, c);
+      }
+      break;
+
+    case SAX_LITERAL:
+      if (c != (uint8_t)sax->literal[sax->literal_pos]) {
+	stop(sax, JSON_SAX_REJECT);
+      } else if (0 == sax->literal[++sax->literal_pos]) {
+	end_literal(sax);
+      }
+      break;
+
+    default:
+      structure_byte(sax, c);
+    }
+  }
+  return sax->status;
+}
+
+json_sax_status_t json_sax_finish(json_sax_t *sax) {
+  if (JSON_SAX_MORE != sax->status) {
+    return sax->status;
+  }
+  if (SAX_NUMBER == sax->state && 0 == sax->depth && JSON_SAX_MORE != end_number(sax)) {
+    return sax->status;
+  }
+  if (SAX_END != sax->state || sax->ws_pending) {
+    return stop(sax, JSON_SAX_REJECT);
+  }
+  return stop(sax, JSON_SAX_DONE);
+}
@@ -0,0 +1,746 @@
+// Hammering-webserver suite
+//
+// The web server: an epoll event loop per core around the parsers
+//
+// Every thread has its own listening socket on the same port
+// (SO_REUSEPORT, the kernel spreads the connections), its own epoll
+// set and its own connections. Nothing is shared between the threads
+// but the parsers, which are immutable once built.
+//
+// A connection reads into its own buffer. The pre-scan finds the end
+// of the head. The router finds routes with a method and path from the
+// request line (router.c); the other routes get the complete head, in
+// order. The body is framed by its Content-Length or chunked. Parse results come from a parse context per
+// connection that we reset after each request. Pipelined requests in
+// the buffer are handled in order; the connection stays open unless
+// the client asks for Connection: close or sends something we reject.
+// Every request gets counted in the metrics of its thread (metrics.h).
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#define _GNU_SOURCE // accept4
+
+#include <hammer/hammer.h>
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "parser-helpers.h"
+#include "http.h"
+#include "prescan.h"
+#include "message.h"
+#include "context.h"
+#include "server.h"
+#include "router.h"
+#include "metrics.h"
+
+#define READ_SIZE      16384
+#define MAX_EVENTS     64
+#define POLL_MS        100   // how often the loops look at the stop flag
+#define LISTEN_BACKLOG 1024
+#define MAX_READS      16    // per event, so one client can't keep the loop to itself
+#define MAX_OUT        65536 // unsent output past which we stop reading, see conn_flush()
+
+typedef struct conn {
+  int fd;
+  struct conn *prev, *next;   // all connections of the worker
+
+  uint8_t *buf;               // input; the message points into it
+  size_t start, len, cap;     // the request at hand starts at buf + start
+  prescan_t scan;
+  size_t head_len;            // 0 until we have the head
+  const route_t *route;       // the route that took the head
+  chunked_t framing;          // checked this far in a chunked body
+  uint64_t parse_ns;          // spent on the request at hand, see conn_count()
+  message_t msg;
+  parse_ctx_t ctx;
+
+  uint8_t *out;               // responses not sent yet
+  size_t out_len, out_sent, out_cap;
+  int close_after;            // close once out is sent
+} conn_t;
+
+typedef struct {
+  struct server *server;
+  pthread_t thread;
+  int listen_fd;
+  int epoll_fd;
+  conn_t *conns;
+} worker_t;
+
+struct server {
+  server_config_t config;
+  router_t *router;           // the routes with a method and path, NULL without
+  size_t max_input;           // most unparsed input a request may leave, see conn_read()
+  uint16_t port;
+  int stop;
+  int threads;
+  worker_t *workers;
+};
+
+
+//----------------------------------------
+// Sockets
+
+static int listen_socket(const char *host, uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (0 != setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one))) {
+    close(fd);
+    return -1;
+  }
+
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  if (NULL != host && 1 != inet_pton(AF_INET, host, &addr.sin_addr)) {
+    close(fd);
+    return -1;
+  }
+  if (0 != bind(fd, (struct sockaddr *)&addr, sizeof(addr)) || 0 != listen(fd, LISTEN_BACKLOG)) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static uint16_t bound_port(int fd) {
+  struct sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  if (0 != getsockname(fd, (struct sockaddr *)&addr, &len)) {
+    return 0;
+  }
+  return ntohs(addr.sin_port);
+}
+
+
+//----------------------------------------
+// Connections
+
+static conn_t *conn_new(worker_t *w, int fd) {
+  conn_t *c = calloc(1, sizeof(conn_t));
+  if (NULL == c) {
+    return NULL;
+  }
+  size_t ctx_size = w->server->config.ctx_size ? w->server->config.ctx_size : DEFAULT_CONN_CTX_SIZE;
+  if (!parse_ctx_init(&c->ctx, ctx_size)) {
+    free(c);
+    return NULL;
+  }
+  c->fd = fd;
+  c->scan = (prescan_t)PRESCAN_INIT;
+  c->next = w->conns;
+  if (NULL != w->conns) {
+    w->conns->prev = c;
+  }
+  w->conns = c;
+  return c;
+}
+
+static void conn_close(worker_t *w, conn_t *c) {
+  epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  if (NULL != c->prev) {
+    c->prev->next = c->next;
+  } else {
+    w->conns = c->next;
+  }
+  if (NULL != c->next) {
+    c->next->prev = c->prev;
+  }
+  message_free(&c->msg);
+  parse_ctx_free(&c->ctx);
+  free(c->buf);
+  free(c->out);
+  free(c);
+}
+
+// Move the request at hand to the front of the buffer
+static void conn_compact(conn_t *c) {
+  if (0 == c->start) {
+    return;
+  }
+  if (NULL != c->route) {
+    message_rebase(&c->msg, (uintptr_t)(c->buf + c->start), c->len - c->start, c->buf);
+  }
+  memmove(c->buf, c->buf + c->start, c->len - c->start);
+  c->len -= c->start;
+  c->start = 0;
+}
+
+// Make room for n more bytes of input
+static int conn_reserve(conn_t *c, size_t n) {
+  conn_compact(c);
+  if (c->len + n <= c->cap) {
+    return 1;
+  }
+  size_t cap = c->cap ? c->cap : READ_SIZE;
+  while (cap < c->len + n) {
+    cap *= 2;
+  }
+  uintptr_t old = (uintptr_t)c->buf;
+  uint8_t *buf = realloc(c->buf, cap);
+  if (NULL == buf) {
+    return 0;
+  }
+  if (old != (uintptr_t)buf && NULL != c->route) {
+    message_rebase(&c->msg, old, c->len, buf);
+  }
+  c->buf = buf;
+  c->cap = cap;
+  return 1;
+}
+
+/* Forget the request we just answered, keep what follows it.
+ * Pipelined requests get parsed where they are; the leftover moves
+ * to the front once per read, in conn_reserve(), not once per request.
+ */
+static void conn_next_request(conn_t *c) {
+  c->start += c->msg.consumed;
+  if (c->start == c->len) {
+    c->start = c->len = 0;
+  }
+  message_free(&c->msg);
+  parse_ctx_reset(&c->ctx);
+  c->scan = (prescan_t)PRESCAN_INIT;
+  c->head_len = 0;
+  c->route = NULL;
+  c->parse_ns = 0;
+}
+
+
+//----------------------------------------
+// Responses
+
+static const char *reason(int status) {
+  switch (status) {
+  case 200: return "OK";
+  case 201: return "Created";
+  case 204: return "No Content";
+  case 400: return "Bad Request";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 409: return "Conflict";
+  case 413: return "Payload Too Large";
+  case 431: return "Request Header Fields Too Large";
+  case 500: return "Internal Server Error";
+  default:  return "Unknown";
+  }
+}
+
+// Too much output the client hasn't taken: no new requests until it does
+static int out_full(const conn_t *c) {
+  return c->out_len - c->out_sent >= MAX_OUT;
+}
+
+static int out_append(conn_t *c, const void *data, size_t len) {
+  if (c->out_len + len > c->out_cap && 0 != c->out_sent) {
+    // what's sent makes room, before we grow
+    memmove(c->out, c->out + c->out_sent, c->out_len - c->out_sent);
+    c->out_len -= c->out_sent;
+    c->out_sent = 0;
+  }
+  if (c->out_len + len > c->out_cap) {
+    size_t cap = c->out_cap ? c->out_cap : 1024;
+    while (cap < c->out_len + len) {
+      cap *= 2;
+    }
+    uint8_t *out = realloc(c->out, cap);
+    if (NULL == out) {
+      return 0;
+    }
+    c->out = out;
+    c->out_cap = cap;
+  }
+  memcpy(c->out + c->out_len, data, len);
+  c->out_len += len;
+  return 1;
+}
+
+// Queue a response
+static int respond(conn_t *c, const response_t *res) {
+  char head[256];
+  int n = snprintf(head, sizeof(head),
+		   "HTTP/1.1 %d %s\r\n"
+		   "Content-Length: %zu\r\n"
+		   "%s%s%s"
+		   "%s"
+		   "\r\n",
+		   res->status, reason(res->status),
+		   res->body_len,
+		   res->content_type ? "Content-Type: " : "",
+		   res->content_type ? res->content_type : "",
+		   res->content_type ? "\r\n" : "",
+		   c->close_after ? "Connection: close\r\n" : "");
+  if (n < 0 || (size_t)n >= sizeof(head)) {
+    return 0;
+  }
+  return out_append(c, head, n) && out_append(c, res->body, res->body_len);
+}
+
+// Queue an error and close the connection after it
+static int respond_error(conn_t *c, int status) {
+  response_t res = { status, NULL, NULL, 0 };
+  c->close_after = 1;
+  return respond(c, &res);
+}
+
+/* Send what we can.
+ * While the output is full, or after the last answer, we wait for the
+ * socket to take more and don't read: a client that doesn't read its
+ * answers can't make us queue them without end.
+ * Returns 0 when the connection is done for.
+ */
+static int conn_flush(worker_t *w, conn_t *c) {
+  while (c->out_sent < c->out_len) {
+    ssize_t n = send(c->fd, c->out + c->out_sent, c->out_len - c->out_sent, MSG_NOSIGNAL);
+    if (n < 0 && EINTR == errno) {
+      continue;
+    }
+    if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+      break;
+    }
+    if (n <= 0) {
+      return 0;
+    }
+    c->out_sent += n;
+  }
+
+  struct epoll_event ev = { .data.ptr = c };
+  if (c->out_sent < c->out_len) {
+    ev.events = c->close_after || out_full(c) ? EPOLLOUT : EPOLLIN | EPOLLOUT;
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    return 1;
+  }
+  c->out_len = c->out_sent = 0;
+  if (c->close_after) {
+    return 0;
+  }
+  ev.events = EPOLLIN;
+  epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+  return 1;
+}
+
+
+//----------------------------------------
+// Requests
+
+/* Find the route by the method and path of the request line,
+ * and parse the rest of the head with it.
+ * Returns NULL when there is no such route, or it doesn't take the head.
+ */
+static const route_t *match_router(worker_t *w, conn_t *c) {
+  HAllocator *mm__ = &c->ctx.allocator;
+  const uint8_t *head = c->buf + c->start;
+  // the pre-scan saw to it that the line is there, with its CR
+  size_t line_len = (const uint8_t *)memchr(head, '\n', c->head_len) - head + 1;
+  HBytes method, uri;
+  if (!scan_request_line(head, line_len, &method, &uri)) {
+    return NULL;
+  }
+  const route_t *route = router_find(w->server->router, method.token, method.len, uri.token, uri.len);
+  if (NULL == route) {
+    return NULL;
+  }
+  HParseResult *res = http_parse__m(mm__, route->head_p, head + line_len, c->head_len - line_len);
+  if (NULL == res || (size_t)(res->bit_length / 8) != c->head_len - line_len) {
+    return NULL;
+  }
+  c->msg.head_result = res;
+  c->msg.head = res->ast;
+  return route;
+}
+
+// Which status a route head over its limits gets; 0 when it wasn't
+static int over_limits(void) {
+  switch (governor_exceeded()) {
+  case LIMIT_NONE:    return 0;
+  case LIMIT_HEADERS:
+  case LIMIT_LINE:    return 431;
+  default:            return 413;
+  }
+}
+
+/* Find the route for a complete head.
+ * Returns NULL and the status to answer when there is none.
+ */
+static const route_t *match_route(worker_t *w, conn_t *c, int *status) {
+  const server_config_t *config = &w->server->config;
+  HAllocator *mm__ = &c->ctx.allocator;
+
+  // the router may answer without a parse; no limits from the last request
+  governor_begin();
+  if (NULL != w->server->router) {
+    const route_t *route = match_router(w, c);
+    if (NULL != route) {
+      return route;
+    }
+    if (0 != (*status = over_limits())) {
+      return NULL;
+    }
+  }
+  for (size_t i = 0; i < config->routes_len; i++) {
+    if (NULL != config->routes[i].path) {
+      continue;
+    }
+    HParseResult *res = http_parse__m(mm__, config->routes[i].head_p, c->buf + c->start, c->head_len);
+    if (NULL != res && (size_t)(res->bit_length / 8) == c->head_len) {
+      c->msg.head_result = res;
+      c->msg.head = res->ast;
+      return &config->routes[i];
+    }
+    // over the limits of a limited() route: no use trying the others
+    if (0 != (*status = over_limits())) {
+      return NULL;
+    }
+  }
+  // a well-formed request nobody wants, or junk?
+  HParseResult *res = http_parse__m(mm__, any_request_head(), c->buf + c->start, c->head_len);
+  *status = (NULL != res && (size_t)(res->bit_length / 8) == c->head_len) ? 404 : 400;
+  return NULL;
+}
+
+/* Count the request at hand in the metrics (metrics.h): POST routes
+ * as post, the rest as generic requests.
+ */
+static void conn_count(conn_t *c, metric_reject_t reject) {
+  metric_entry_t entry = ENTRY_HTTP_REQUEST;
+  if (NULL != c->route && NULL != c->route->method && 0 == strcmp("POST", c->route->method)) {
+    entry = ENTRY_POST;
+  }
+  // the whole request when we got that far, else the head, else what's there
+  size_t input = c->msg.consumed ? c->msg.consumed : c->head_len ? c->head_len : c->len - c->start;
+  metrics_record(entry, c->parse_ns, input, c->ctx.used + c->ctx.overflow_bytes, reject);
+}
+
+// A head we answer 400: is it the request line?
+static metric_reject_t head_reject(const conn_t *c) {
+  const uint8_t *head = c->buf + c->start;
+  const uint8_t *lf = memchr(head, '\n', c->len - c->start);
+  HBytes method, uri;
+  if (NULL == lf || !scan_request_line(head, lf - head + 1, &method, &uri)) {
+    return REJECT_START_LINE;
+  }
+  return REJECT_HEADER;
+}
+
+/* Handle every complete request in the buffer, while there's room for
+ * the answers. Returns 0 when the connection is done for.
+ */
+static int conn_requests(worker_t *w, conn_t *c) {
+  while (!c->close_after && !out_full(c)) {
+    uint64_t start = metrics_clock();
+    if (NULL == c->route) {
+      prescan_status_t pre = prescan_head(&c->scan, c->buf + c->start, c->len - c->start, &prescan_default_limits, &c->head_len);
+      if (PRESCAN_INCOMPLETE == pre) {
+	c->parse_ns += metrics_clock() - start;
+	return 1;
+      }
+      if (PRESCAN_COMPLETE != pre) {
+	int too_large = MSG_TOO_LARGE == message_status_of(pre);
+	c->parse_ns += metrics_clock() - start;
+	conn_count(c, too_large ? REJECT_LIMIT : head_reject(c));
+	return respond_error(c, too_large ? 431 : 400);
+      }
+      int status;
+      c->route = match_route(w, c, &status);
+      if (NULL == c->route) {
+	c->parse_ns += metrics_clock() - start;
+	// a 404 is no reject, nor an accepted parse: it isn't counted
+	if (404 != status) {
+	  conn_count(c, 400 == status ? head_reject(c) : REJECT_LIMIT);
+	}
+	// we don't know how long its body is, so this is the end
+	return respond_error(c, status);
+      }
+      chunked_init(&c->framing, c->route->max_body);
+    }
+
+    message_status_t status = resume_message_body__m(&c->ctx.allocator, c->route->body_p, c->route->max_body,
+						     c->buf + c->start, c->len - c->start, c->head_len,
+						     &c->framing, &c->msg);
+    c->parse_ns += metrics_clock() - start;
+    switch (status) {
+    case MSG_INCOMPLETE: return 1;
+    case MSG_TOO_LARGE:  conn_count(c, REJECT_LIMIT); return respond_error(c, 413);
+    case MSG_REJECT:     conn_count(c, REJECT_BODY);  return respond_error(c, 400);
+    case MSG_OK:         conn_count(c, REJECT_NONE);  break;
+    }
+
+    response_t res = { 200, NULL, NULL, 0 };
+    c->route->handler(&c->msg, &res, c->route->user_data);
+    c->close_after = !message_keep_alive(&c->msg);
+    if (!respond(c, &res)) {
+      return 0;
+    }
+    conn_next_request(c);
+  }
+  return 1;
+}
+
+/* Send, and handle the requests that waited in the buffer while the
+ * output was full, for as long as the socket takes the answers.
+ * Returns 0 when the connection is done for.
+ */
+static int conn_write(worker_t *w, conn_t *c) {
+  while (!c->close_after && out_full(c)) {
+    if (!conn_flush(w, c)) {
+      return 0;
+    }
+    if (out_full(c)) {
+      return 1; // the socket is full too; on EPOLLOUT we go on
+    }
+    if (!conn_requests(w, c)) {
+      return 0;
+    }
+  }
+  return conn_flush(w, c);
+}
+
+
+/* Read what's there and handle it.
+ * Returns 0 when the connection is done for.
+ */
+static int conn_read(worker_t *w, conn_t *c) {
+  // Parse after every read: the limits of the pre-scan and the routes
+  // see the input as it comes, and pipelined requests get out of the
+  // buffer. What's left is part of one request, less than max_input,
+  // or requests that wait for room in the output: then we stop reading.
+  // After MAX_READS the rest waits in the socket for the next event.
+  for (int reads = 0; reads < MAX_READS && !c->close_after && !out_full(c); reads++) {
+    if (c->len - c->start >= w->server->max_input) {
+      // the limits should have said no by now; don't grow on if they didn't
+      if (!respond_error(c, 413)) {
+	return 0;
+      }
+      break;
+    }
+    if (!conn_reserve(c, READ_SIZE)) {
+      return 0;
+    }
+    ssize_t n = recv(c->fd, c->buf + c->len, c->cap - c->len, 0);
+    if (n < 0 && EINTR == errno) {
+      continue;
+    }
+    if (n < 0 && (EAGAIN == errno || EWOULDBLOCK == errno)) {
+      break;
+    }
+    if (n <= 0) {
+      return 0; // closed, or broken
+    }
+    c->len += n;
+    if (!conn_requests(w, c)) {
+      return 0;
+    }
+    if ((size_t)n < READ_SIZE) {
+      break;
+    }
+  }
+  return conn_write(w, c);
+}
+
+
+//----------------------------------------
+// Event loop
+
+static void accept_all(worker_t *w) {
+  for (;;) {
+    int fd = accept4(w->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      return; // EAGAIN: that's all of them. Anything else: try again later.
+    }
+    conn_t *c = conn_new(w, fd);
+    if (NULL == c) {
+      close(fd);
+      continue;
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+    if (0 != epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &ev)) {
+      conn_close(w, c);
+    }
+  }
+}
+
+static void *worker_loop(void *arg) {
+  worker_t *w = arg;
+  struct epoll_event events[MAX_EVENTS];
+
+  while (!__atomic_load_n(&w->server->stop, __ATOMIC_ACQUIRE)) {
+    int n = epoll_wait(w->epoll_fd, events, MAX_EVENTS, POLL_MS);
+    for (int i = 0; i < n; i++) {
+      conn_t *c = events[i].data.ptr;
+      if (NULL == c) {
+	accept_all(w);
+	continue;
+      }
+      int alive;
+      if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+	alive = 0;
+      } else if (events[i].events & EPOLLIN) {
+	alive = conn_read(w, c);
+      } else {
+	alive = conn_write(w, c);
+      }
+      if (!alive) {
+	conn_close(w, c);
+      }
+    }
+  }
+
+  while (NULL != w->conns) {
+    conn_close(w, w->conns);
+  }
+  return NULL;
+}
+
+
+//----------------------------------------
+// Server
+
+static int worker_init(server_t *server, worker_t *w) {
+  w->server = server;
+  w->listen_fd = listen_socket(server->config.host, server->port);
+  if (w->listen_fd < 0) {
+    return 0;
+  }
+  if (0 == server->port) {
+    server->port = bound_port(w->listen_fd); // the others go on the same port
+  }
+  w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (w->epoll_fd < 0) {
+    close(w->listen_fd);
+    return 0;
+  }
+  struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+  if (0 != epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->listen_fd, &ev)) {
+    close(w->epoll_fd);
+    close(w->listen_fd);
+    return 0;
+  }
+  return 1;
+}
+
+static void worker_free(worker_t *w) {
+  close(w->epoll_fd);
+  close(w->listen_fd);
+}
+
+
+/* Put the routes with a method and path in the router.
+ * Returns 0 when two of them have the same, or out of memory.
+ */
+static int build_router(server_t *server) {
+  const server_config_t *config = &server->config;
+  for (size_t i = 0; i < config->routes_len; i++) {
+    const route_t *route = &config->routes[i];
+    if (NULL == route->path) {
+      continue;
+    }
+    if (NULL == server->router && NULL == (server->router = router_new())) {
+      return 0;
+    }
+    if (!router_add(server->router, route->method, route->path, route)) {
+      router_free(server->router);
+      server->router = NULL;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+server_t *server_start(const server_config_t *config) {
+  server_t *server = calloc(1, sizeof(server_t));
+  if (NULL == server) {
+    return NULL;
+  }
+  server->config = *config;
+  server->port = config->port;
+  server->threads = config->threads > 0 ? config->threads : (int)sysconf(_SC_NPROCESSORS_ONLN);
+  if (server->threads < 1) {
+    server->threads = 1;
+  }
+  server->workers = calloc(server->threads, sizeof(worker_t));
+  if (NULL == server->workers) {
+    free(server);
+    return NULL;
+  }
+  if (!build_router(server)) {
+    free(server->workers);
+    free(server);
+    return NULL;
+  }
+  // a head, and the largest body with its chunked framing (chunked.h)
+  size_t max_body = 0;
+  for (size_t i = 0; i < config->routes_len; i++) {
+    if (config->routes[i].max_body > max_body) {
+      max_body = config->routes[i].max_body;
+    }
+  }
+  server->max_input = prescan_default_limits.max_head + 2 * max_body + DEFAULT_MAX_CHUNK_LINE + READ_SIZE;
+
+  // All sockets first: with port 0 the first one picks the port.
+  int ready = 0;
+  for (; ready < server->threads; ready++) {
+    if (!worker_init(server, &server->workers[ready])) {
+      break;
+    }
+  }
+  int started = 0;
+  if (ready == server->threads) {
+    for (; started < server->threads; started++) {
+      worker_t *w = &server->workers[started];
+      if (0 != pthread_create(&w->thread, NULL, worker_loop, w)) {
+	break;
+      }
+    }
+  }
+  if (started < server->threads) {
+    __atomic_store_n(&server->stop, 1, __ATOMIC_RELEASE);
+    for (int i = 0; i < started; i++) {
+      pthread_join(server->workers[i].thread, NULL);
+    }
+    for (int i = 0; i < ready; i++) {
+      worker_free(&server->workers[i]);
+    }
+    if (NULL != server->router) {
+      router_free(server->router);
+    }
+    free(server->workers);
+    free(server);
+    return NULL;
+  }
+  return server;
+}
+
+
+uint16_t server_port(const server_t *server) {
+  return server->port;
+}
+
+
+void server_stop(server_t *server) {
+  __atomic_store_n(&server->stop, 1, __ATOMIC_RELEASE);
+  for (int i = 0; i < server->threads; i++) {
+    pthread_join(server->workers[i].thread, NULL);
+    worker_free(&server->workers[i]);
+  }
+  if (NULL != server->router) {
+    router_free(server->router);
+  }
+  free(server->workers);
+  free(server);
+}
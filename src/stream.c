@@ -0,0 +1,166 @@
+// Hammering-webserver suite
+//
+// Incremental parsing of messages that arrive in pieces
+//
+// Requests come in over several reads. Re-parsing the whole buffer after
+// every read is quadratic; here every byte gets looked at once.
+//
+// When the head parser is compiled for a backend that can parse in
+// chunks (LL(k), LALR), the bytes of the head go to h_parse_chunk as
+// they arrive, up to where the pre-scan finds its end.
+// Packrat can't do that, so then the pre-scan looks for the empty line
+// that ends the head in the new bytes only, and we run the grammar once
+// on the complete head. The pre-scan throws out junk in both cases.
+// The body is framed by Content-Length: no scanning at all. A chunked
+// body's framing goes on from where the last feed left it.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "parser-helpers.h"
+#include "http.h"
+#include "prescan.h"
+#include "message.h"
+#include "stream.h"
+
+#define STREAM_INITIAL_CAP 1024
+
+
+void stream_init(stream_t *s, const HParser *head_p, const HParser *body_p,
+		 size_t max_head, size_t max_body) {
+  stream_init__m(NULL, s, head_p, body_p, max_head, max_body);
+}
+
+void stream_init__m(HAllocator *mm__, stream_t *s, const HParser *head_p, const HParser *body_p,
+		    size_t max_head, size_t max_body) {
+  memset(s, 0, sizeof(*s));
+  s->mm__ = mm__;
+  s->head_p = head_p;
+  s->body_p = body_p;
+  s->max_head = max_head;
+  s->max_body = max_body;
+  chunked_init(&s->framing, max_body);
+  // NULL when the backend can't do chunks, i.e. packrat
+  s->suspended = mm__ ? h_parse_start__m(mm__, head_p) : h_parse_start(head_p);
+}
+
+
+// Append input to the buffer
+static int buffer_append(stream_t *s, const uint8_t *input, size_t length) {
+  if (s->len + length > s->cap) {
+    size_t cap = s->cap ? s->cap : STREAM_INITIAL_CAP;
+    while (cap < s->len + length) {
+      cap *= 2;
+    }
+    uintptr_t old = (uintptr_t)s->buf;
+    uint8_t *buf = realloc(s->buf, cap);
+    if (NULL == buf) {
+      return 0;
+    }
+    if (old != (uintptr_t)buf) {
+      message_rebase(&s->msg, old, s->len, buf);
+    }
+    s->buf = buf;
+    s->cap = cap;
+  }
+  memcpy(s->buf + s->len, input, length);
+  s->len += length;
+  return 1;
+}
+
+
+// Parse the head, once we know where it ends
+static int parse_head(stream_t *s, size_t head_len) {
+  s->msg.head_result = http_parse__m(s->mm__, s->head_p, s->buf, head_len);
+  if (NULL == s->msg.head_result || (size_t)(s->msg.head_result->bit_length / 8) != head_len) {
+    return 0;
+  }
+  s->msg.head = s->msg.head_result->ast;
+  s->head_len = head_len;
+  return 1;
+}
+
+
+// Feed the head parser that takes chunks the new bytes of the head.
+// head_len is 0 while the pre-scan hasn't found the end; when it has,
+// the body stays out and the head must end right there.
+static int feed_suspended(stream_t *s, const uint8_t *input, size_t length, size_t head_len) {
+  if (0 != head_len) {
+    length = head_len - (s->len - length);
+  }
+  if (!h_parse_chunk(s->suspended, input, length) && 0 == head_len) {
+    return 1; // wants more
+  }
+  s->msg.head_result = h_parse_finish(s->suspended);
+  s->suspended = NULL;
+  if (NULL == s->msg.head_result || (size_t)(s->msg.head_result->bit_length / 8) != head_len) {
+    return 0;
+  }
+  s->msg.head = s->msg.head_result->ast;
+  s->head_len = head_len;
+  return 1;
+}
+
+
+static stream_status_t reject(stream_t *s, message_status_t status) {
+  s->status = status;
+  return STREAM_REJECT;
+}
+
+
+stream_status_t stream_feed(stream_t *s, const uint8_t *input, size_t length) {
+  if (!buffer_append(s, input, length)) {
+    return reject(s, MSG_TOO_LARGE);
+  }
+
+  if (0 == s->head_len) {
+    prescan_limits_t limits = prescan_default_limits;
+    limits.max_head = s->max_head;
+    size_t head_len = 0;
+    prescan_status_t pre = prescan_head(&s->scan, s->buf, s->len, &limits, &head_len);
+    if (PRESCAN_COMPLETE != pre && PRESCAN_INCOMPLETE != pre) {
+      return reject(s, message_status_of(pre));
+    }
+
+    if (NULL != s->suspended) {
+      if (!feed_suspended(s, input, length, PRESCAN_COMPLETE == pre ? head_len : 0)) {
+	return reject(s, MSG_REJECT);
+      }
+    } else if (PRESCAN_COMPLETE == pre && !parse_head(s, head_len)) {
+      return reject(s, MSG_REJECT);
+    }
+    if (0 == s->head_len) {
+      return STREAM_MORE;
+    }
+  }
+
+  // We have the head; the body is there or it isn't.
+  if (NULL != s->msg.body_result) {
+    h_parse_result_free(s->msg.body_result);
+    s->msg.body_result = NULL;
+  }
+  s->status = resume_message_body__m(s->mm__, s->body_p, s->max_body, s->buf, s->len, s->head_len,
+				     &s->framing, &s->msg);
+  switch (s->status) {
+  case MSG_OK:         return STREAM_DONE;
+  case MSG_INCOMPLETE: return STREAM_MORE;
+  default:             return STREAM_REJECT;
+  }
+}
+
+
+void stream_free(stream_t *s) {
+  if (NULL != s->suspended) {
+    HParseResult *res = h_parse_finish(s->suspended);
+    if (NULL != res) {
+      h_parse_result_free(res);
+    }
+  }
+  message_free(&s->msg);
+  free(s->buf);
+  memset(s, 0, sizeof(*s));
+}
@@ -0,0 +1,424 @@
+// Hammering-webserver suite
+//
+// JSON tapes: a parsed JSON value as one flat array of words
+//
+// The json parser gives a tree of tokens: fine to check the input,
+// costly to keep and slow to walk. The tape is the same value in two
+// arrays. json_tape_parse() fills them from the SAX parser as it goes,
+// so the tree never gets built; json_tape_from() sizes them in a first
+// pass over a tree that is there already, and fills them in a second.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdlib.h>
+#include <string.h>
+#include "json.h"
+#include "sax.h"
+#include "token-types.h"
+#include "tape.h"
+
+#define TYPE_SHIFT    56
+#define COUNT_SHIFT   32
+#define COUNT_MAX     0xFFFFFF
+#define POS_MASK      0xFFFFFFFF
+#define STRING_HEADER sizeof(uint32_t)
+
+static uint64_t word(uint8_t type, uint64_t payload) {
+  return (uint64_t)type << TYPE_SHIFT | payload;
+}
+
+static uint8_t word_type(uint64_t w) {
+  return w >> TYPE_SHIFT;
+}
+
+static uint64_t word_payload(uint64_t w) {
+  return w & ((1ULL << TYPE_SHIFT) - 1);
+}
+
+// The json parser wraps its value in a sequence of one
+static const HParsedToken *unwrap(const HParsedToken *value) {
+  if (TT_SEQUENCE == value->token_type && 1 == value->seq->used) {
+    return value->seq->elements[0];
+  }
+  return value;
+}
+
+
+//----------------------------------------
+// Sizing
+
+/* Count the words and string bytes a value needs.
+ * Returns 0 for tokens that aren't JSON.
+ */
+static int tape_size(const HParsedToken *t, size_t *words, size_t *strings) {
+  switch ((int)t->token_type) {
+  case TT_json_object_t: {
+    const HCountedArray *members = t->user;
+    *words += 2;
+    for (size_t i = 0; i < members->used; i++) {
+      const HParsedToken *member = members->elements[i];
+      if (TT_SEQUENCE != member->token_type || 2 != member->seq->used ||
+	  !tape_size(member->seq->elements[0], words, strings) ||
+	  !tape_size(member->seq->elements[1], words, strings)) {
+	return 0;
+      }
+    }
+    return 1;
+  }
+  case TT_json_array_t: {
+    const HCountedArray *elements = t->user;
+    *words += 2;
+    for (size_t i = 0; i < elements->used; i++) {
+      if (!tape_size(elements->elements[i], words, strings)) {
+	return 0;
+      }
+    }
+    return 1;
+  }
+  case TT_BYTES:
+    *words += 1;
+    *strings += STRING_HEADER + t->bytes.len + 1;
+    return t->bytes.len <= UINT32_MAX;
+  case TT_json_number_t:
+    *words += 2;
+    return 1;
+  case TT_json_literal_t:
+    *words += 1;
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+//----------------------------------------
+// Writing
+
+static void write_value(json_tape_t *tape, const HParsedToken *t);
+
+static void write_container(json_tape_t *tape, uint8_t open, uint8_t close, const HCountedArray *elements) {
+  size_t start = tape->len++;
+  for (size_t i = 0; i < elements->used; i++) {
+    const HParsedToken *e = elements->elements[i];
+    if (JSON_T_OBJECT == open) {
+      // a member: name and value
+      write_value(tape, e->seq->elements[0]);
+      write_value(tape, e->seq->elements[1]);
+    } else {
+      write_value(tape, e);
+    }
+  }
+  uint64_t count = elements->used < COUNT_MAX ? elements->used : COUNT_MAX;
+  tape->words[start] = word(open, count << COUNT_SHIFT | tape->len);
+  tape->words[tape->len] = word(close, start);
+  tape->len++;
+}
+
+static void write_value(json_tape_t *tape, const HParsedToken *t) {
+  switch ((int)t->token_type) {
+  case TT_json_object_t:
+    write_container(tape, JSON_T_OBJECT, '}', t->user);
+    break;
+  case TT_json_array_t:
+    write_container(tape, JSON_T_ARRAY, ']', t->user);
+    break;
+  case TT_BYTES: {
+    uint32_t len = t->bytes.len;
+    tape->words[tape->len++] = word(JSON_T_STRING, tape->strings_len);
+    memcpy(tape->strings + tape->strings_len, &len, STRING_HEADER);
+    memcpy(tape->strings + tape->strings_len + STRING_HEADER, t->bytes.token, len);
+    tape->strings[tape->strings_len + STRING_HEADER + len] = 0;
+    tape->strings_len += STRING_HEADER + len + 1;
+    break;
+  }
+  case TT_json_number_t: {
+    const json_number_t *num = t->user;
+    if (JSON_INT == num->kind) {
+      tape->words[tape->len++] = word(JSON_T_INT, 0);
+      memcpy(&tape->words[tape->len++], &num->i, sizeof(uint64_t));
+    } else {
+      tape->words[tape->len++] = word(JSON_T_DOUBLE, 0);
+      memcpy(&tape->words[tape->len++], &num->d, sizeof(uint64_t));
+    }
+    break;
+  }
+  case TT_json_literal_t:
+    switch (*(const json_literal_t *)t->user) {
+    case JSON_TRUE:  tape->words[tape->len++] = word(JSON_T_TRUE, 0);  break;
+    case JSON_FALSE: tape->words[tape->len++] = word(JSON_T_FALSE, 0); break;
+    case JSON_NULL:  tape->words[tape->len++] = word(JSON_T_NULL, 0);  break;
+    }
+    break;
+  }
+}
+
+int json_tape_from(json_tape_t *tape, const HParsedToken *value) {
+  memset(tape, 0, sizeof(*tape));
+  value = unwrap(value);
+
+  size_t words = 0, strings = 0;
+  if (!tape_size(value, &words, &strings) || words > POS_MASK) {
+    return 0;
+  }
+  tape->words = malloc(words * sizeof(uint64_t));
+  tape->strings = malloc(strings ? strings : 1);
+  if (NULL == tape->words || NULL == tape->strings) {
+    json_tape_free(tape);
+    return 0;
+  }
+  write_value(tape, value);
+  return 1;
+}
+
+void json_tape_free(json_tape_t *tape) {
+  free(tape->words);
+  free(tape->strings);
+  memset(tape, 0, sizeof(*tape));
+}
+
+
+//----------------------------------------
+// Writing while parsing
+
+/* The SAX parser calls us in document order, so every word goes at the
+ * end of the tape. An open word gets its count and the position of
+ * its close word when the close comes.
+ */
+typedef struct {
+  json_tape_t *tape;
+  size_t words_cap;
+  size_t strings_cap;
+  size_t open[DEFAULT_SAX_DEPTH];   // per level: where its open word is
+  size_t count[DEFAULT_SAX_DEPTH];  // per level: elements or members so far
+  size_t depth;
+} tape_writer_t;
+
+static int put_word(tape_writer_t *w, uint64_t word) {
+  json_tape_t *tape = w->tape;
+  if (tape->len >= POS_MASK) {
+    return 0; // positions are 32 bits
+  }
+  if (tape->len == w->words_cap) {
+    size_t cap = w->words_cap ? 2 * w->words_cap : 64;
+    uint64_t *words = realloc(tape->words, cap * sizeof(uint64_t));
+    if (NULL == words) {
+      return 0;
+    }
+    tape->words = words;
+    w->words_cap = cap;
+  }
+  tape->words[tape->len++] = word;
+  return 1;
+}
+
+// The word of a value; in an array, one more element
+static int put_value(tape_writer_t *w, uint64_t word) {
+  if (w->depth > 0 && JSON_T_ARRAY == word_type(w->tape->words[w->open[w->depth - 1]])) {
+    w->count[w->depth - 1]++;
+  }
+  return put_word(w, word);
+}
+
+static int put_string(tape_writer_t *w, const uint8_t *s, size_t len) {
+  json_tape_t *tape = w->tape;
+  size_t need = STRING_HEADER + len + 1;
+  if (len > UINT32_MAX) {
+    return 0;
+  }
+  if (tape->strings_len + need > w->strings_cap) {
+    size_t cap = w->strings_cap ? w->strings_cap : 256;
+    while (cap < tape->strings_len + need) {
+      cap *= 2;
+    }
+    uint8_t *strings = realloc(tape->strings, cap);
+    if (NULL == strings) {
+      return 0;
+    }
+    tape->strings = strings;
+    w->strings_cap = cap;
+  }
+  uint32_t l = len;
+  memcpy(tape->strings + tape->strings_len, &l, STRING_HEADER);
+  memcpy(tape->strings + tape->strings_len + STRING_HEADER, s, len);
+  tape->strings[tape->strings_len + STRING_HEADER + len] = 0;
+  tape->strings_len += need;
+  return 1;
+}
+
+static int put_open(tape_writer_t *w, uint8_t type) {
+  if (!put_value(w, word(type, 0))) {
+    return 0;
+  }
+  w->open[w->depth] = w->tape->len - 1;
+  w->count[w->depth] = 0;
+  w->depth++;
+  return 1;
+}
+
+static int put_close(tape_writer_t *w, uint8_t type) {
+  w->depth--;
+  size_t start = w->open[w->depth];
+  uint64_t count = w->count[w->depth] < COUNT_MAX ? w->count[w->depth] : COUNT_MAX;
+  w->tape->words[start] = word(word_type(w->tape->words[start]), count << COUNT_SHIFT | w->tape->len);
+  return put_word(w, word(type, start));
+}
+
+static int on_start_object(void *w) { return put_open(w, JSON_T_OBJECT); }
+static int on_end_object(void *w)   { return put_close(w, '}'); }
+static int on_start_array(void *w)  { return put_open(w, JSON_T_ARRAY); }
+static int on_end_array(void *w)    { return put_close(w, ']'); }
+static int on_null(void *w)         { return put_value(w, word(JSON_T_NULL, 0)); }
+
+static int on_boolean(void *w, int value) {
+  return put_value(w, word(value ? JSON_T_TRUE : JSON_T_FALSE, 0));
+}
+
+// A member: its name counts, its value doesn't
+static int on_key(void *user_data, const uint8_t *name, size_t len) {
+  tape_writer_t *w = user_data;
+  w->count[w->depth - 1]++;
+  return put_word(w, word(JSON_T_STRING, w->tape->strings_len)) && put_string(w, name, len);
+}
+
+static int on_string(void *user_data, const uint8_t *s, size_t len) {
+  tape_writer_t *w = user_data;
+  return put_value(w, word(JSON_T_STRING, w->tape->strings_len)) && put_string(w, s, len);
+}
+
+static int on_number(void *w, const json_number_t *n) {
+  uint64_t bits;
+  if (JSON_INT == n->kind) {
+    memcpy(&bits, &n->i, sizeof(bits));
+  } else {
+    memcpy(&bits, &n->d, sizeof(bits));
+  }
+  return put_value(w, word(JSON_INT == n->kind ? JSON_T_INT : JSON_T_DOUBLE, 0)) && put_word(w, bits);
+}
+
+static const json_sax_callbacks_t tape_callbacks = {
+  on_start_object, on_end_object, on_start_array, on_end_array,
+  on_key, on_string, on_number, on_boolean, on_null,
+};
+
+int json_tape_parse(json_tape_t *tape, const uint8_t *input, size_t length) {
+  memset(tape, 0, sizeof(*tape));
+  tape_writer_t w = { tape, 0, 0, { 0 }, { 0 }, 0 };
+  json_sax_t sax;
+  // no name, string or number is longer than the input
+  if (!json_sax_init(&sax, &tape_callbacks, &w, DEFAULT_SAX_DEPTH, length)) {
+    return 0;
+  }
+  json_sax_feed(&sax, input, length);
+  int ok = JSON_SAX_DONE == json_sax_finish(&sax);
+  json_sax_free(&sax);
+  if (!ok) {
+    json_tape_free(tape);
+  }
+  return ok;
+}
+
+
+//----------------------------------------
+// Cursors
+
+json_cursor_t json_root(const json_tape_t *tape) {
+  json_cursor_t c = { tape, 0 };
+  return c;
+}
+
+json_type_t json_type(json_cursor_t c) {
+  if (c.pos >= c.tape->len) {
+    return JSON_T_END;
+  }
+  uint8_t type = word_type(c.tape->words[c.pos]);
+  return ('}' == type || ']' == type) ? JSON_T_END : (json_type_t)type;
+}
+
+json_cursor_t json_next(json_cursor_t c) {
+  switch (json_type(c)) {
+  case JSON_T_OBJECT:
+  case JSON_T_ARRAY:
+    c.pos = (word_payload(c.tape->words[c.pos]) & POS_MASK) + 1;
+    break;
+  case JSON_T_INT:
+  case JSON_T_DOUBLE:
+    c.pos += 2;
+    break;
+  case JSON_T_END:
+    break; // stay put
+  default:
+    c.pos += 1;
+  }
+  return c;
+}
+
+json_cursor_t json_first(json_cursor_t c) {
+  json_type_t type = json_type(c);
+  if (JSON_T_OBJECT == type || JSON_T_ARRAY == type) {
+    c.pos++;
+  }
+  return c;
+}
+
+size_t json_count(json_cursor_t c) {
+  json_type_t type = json_type(c);
+  if (JSON_T_OBJECT != type && JSON_T_ARRAY != type) {
+    return 0;
+  }
+  return word_payload(c.tape->words[c.pos]) >> COUNT_SHIFT;
+}
+
+/* Find the member called name in an object.
+ * Returns 0 when there is none, or c is no object.
+ */
+int json_find(json_cursor_t c, const uint8_t *name, size_t len, json_cursor_t *value) {
+  if (JSON_T_OBJECT != json_type(c)) {
+    return 0;
+  }
+  for (json_cursor_t m = json_first(c); JSON_T_STRING == json_type(m); m = json_next(json_next(m))) {
+    size_t mlen;
+    const uint8_t *mname = json_string(m, &mlen);
+    if (mlen == len && 0 == memcmp(mname, name, len)) {
+      *value = json_next(m);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int64_t json_int(json_cursor_t c) {
+  int64_t i = 0;
+  if (JSON_T_INT == json_type(c)) {
+    memcpy(&i, &c.tape->words[c.pos + 1], sizeof(i));
+  }
+  return i;
+}
+
+double json_double(json_cursor_t c) {
+  double d = 0;
+  switch (json_type(c)) {
+  case JSON_T_DOUBLE:
+    memcpy(&d, &c.tape->words[c.pos + 1], sizeof(d));
+    break;
+  case JSON_T_INT:
+    d = (double)json_int(c);
+    break;
+  default:
+    break;
+  }
+  return d;
+}
+
+const uint8_t *json_string(json_cursor_t c, size_t *len) {
+  if (JSON_T_STRING != json_type(c)) {
+    *len = 0;
+    return NULL;
+  }
+  const uint8_t *at = c.tape->strings + word_payload(c.tape->words[c.pos]);
+  uint32_t l;
+  memcpy(&l, at, STRING_HEADER);
+  *len = l;
+  return at + STRING_HEADER;
+}
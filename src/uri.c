@@ -0,0 +1,144 @@
+// Hammering-webserver suite
+//
+// Request-URI: path segments and query parameters
+//
+// The grammar (request_uri() in http.c) checks the uri byte for byte
+// against RFC 3986. Here we only cut the valid uri into its parts:
+// segments between the slashes, and name=value pairs between the
+// ampersands of the query. All of them are spans of the input.
+//
+// Nothing gets decoded until a handler asks for it, and then only when
+// there is a % in the span. Decoding copies the runs between escapes
+// with memcpy (memchr finds the next %, a vector at a time), and a
+// table turns the two hex digits of an escape into a byte.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <hammer/hammer.h>
+#include <stdint.h>
+#include <string.h>
+#include "uri.h"
+
+// Hex digit values
+static const uint8_t hex_value[256] = {
+  ['0'] = 0, ['1'] = 1, ['2'] = 2, ['3'] = 3, ['4'] = 4,
+  ['5'] = 5, ['6'] = 6, ['7'] = 7, ['8'] = 8, ['9'] = 9,
+  ['a'] = 10, ['b'] = 11, ['c'] = 12, ['d'] = 13, ['e'] = 14, ['f'] = 15,
+  ['A'] = 10, ['B'] = 11, ['C'] = 12, ['D'] = 13, ['E'] = 14, ['F'] = 15,
+};
+
+/* Decode %XX escapes.
+ * hex_value is 0 for what isn't a digit: the grammar lets no such
+ * escape through, so decoding stays two lookups and a shift.
+ */
+size_t pct_decode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t o = 0;
+  const uint8_t *end = in + len;
+  while (in < end) {
+    const uint8_t *pct = memchr(in, '%', end - in);
+    size_t run = (pct ? pct : end) - in;
+    memmove(out + o, in, run); // out may be in, and behind it
+    o += run;
+    in += run;
+    if (NULL == pct || end - pct < 3) {
+      break;
+    }
+    out[o++] = (uint8_t)(hex_value[pct[1]] << 4 | hex_value[pct[2]]);
+    in = pct + 3;
+  }
+  return o;
+}
+
+HBytes uri_decode(const uri_t *uri, HBytes raw) {
+  if (0 == raw.len || NULL == memchr(raw.token, '%', raw.len)) {
+    return raw;
+  }
+  uint8_t *out = h_arena_malloc(uri->arena, raw.len);
+  HBytes decoded = { out, pct_decode(raw.token, raw.len, out) };
+  return decoded;
+}
+
+/* Does raw, decoded, equal name? Without decoding into a buffer.
+ */
+static int decoded_equal(HBytes raw, const uint8_t *name, size_t len) {
+  size_t i = 0, j = 0;
+  while (i < raw.len && j < len) {
+    uint8_t c = raw.token[i];
+    if ('%' == c && i + 2 < raw.len) {
+      c = (uint8_t)(hex_value[raw.token[i + 1]] << 4 | hex_value[raw.token[i + 2]]);
+      i += 3;
+    } else {
+      i++;
+    }
+    if (c != name[j++]) {
+      return 0;
+    }
+  }
+  return i == raw.len && j == len;
+}
+
+const query_param_t *uri_param(const uri_t *uri, const uint8_t *name, size_t len) {
+  for (size_t i = 0; i < uri->n_params; i++) {
+    if (decoded_equal(uri->params[i].name, name, len)) {
+      return &uri->params[i];
+    }
+  }
+  return NULL;
+}
+
+
+// How many times c is in s
+static size_t count_char(const uint8_t *s, size_t len, uint8_t c) {
+  size_t n = 0;
+  for (const uint8_t *end = s + len; NULL != (s = memchr(s, c, end - s)); s++) {
+    n++;
+  }
+  return n;
+}
+
+uri_t *uri_new(HArena *arena, const uint8_t *s, size_t len) {
+  uri_t *uri = h_arena_malloc(arena, sizeof(uri_t));
+  memset(uri, 0, sizeof(*uri));
+  uri->arena = arena;
+
+  const uint8_t *q = memchr(s, '?', len);
+  uri->path.token = s;
+  uri->path.len = q ? (size_t)(q - s) : len;
+  if (NULL != q) {
+    uri->query.token = q + 1;
+    uri->query.len = len - uri->path.len - 1;
+  }
+
+  // /a/b/ has three segments: a, b and the empty one
+  uri->n_segments = count_char(uri->path.token, uri->path.len, '/');
+  uri->segments = h_arena_malloc(arena, uri->n_segments * sizeof(HBytes));
+  const uint8_t *p = uri->path.token, *path_end = p + uri->path.len;
+  for (size_t i = 0; i < uri->n_segments; i++) {
+    p++; // the /
+    const uint8_t *next = memchr(p, '/', path_end - p);
+    const uint8_t *seg_end = next ? next : path_end;
+    uri->segments[i].token = p;
+    uri->segments[i].len = seg_end - p;
+    p = seg_end;
+  }
+
+  // at most one pair per &, and one more
+  size_t max_params = uri->query.len ? count_char(uri->query.token, uri->query.len, '&') + 1 : 0;
+  uri->params = h_arena_malloc(arena, (max_params ? max_params : 1) * sizeof(query_param_t));
+  const uint8_t *a = uri->query.token, *query_end = a + uri->query.len;
+  while (a < query_end) {
+    const uint8_t *amp = memchr(a, '&', query_end - a);
+    const uint8_t *pair_end = amp ? amp : query_end;
+    if (pair_end > a) {
+      query_param_t *param = &uri->params[uri->n_params++];
+      const uint8_t *eq = memchr(a, '=', pair_end - a);
+      param->name.token = a;
+      param->name.len = (eq ? eq : pair_end) - a;
+      param->value.token = eq ? eq + 1 : pair_end;
+      param->value.len = pair_end - param->value.token;
+    }
+    a = pair_end + 1;
+  }
+  return uri;
+}
@@ -0,0 +1,358 @@
+// Hammering-webserver suite
+//
+// Generate DFAs for the regular rules of the grammar
+//
+// Some rules in http.c describe regular languages: a run of name
+// characters, a fixed token, three digits. As combinators they still
+// cost an indirect call and a token per byte. This program has the
+// same rules as regular expressions, turns each into an NFA (Thompson),
+// then into a DFA (subset construction), and writes them out as C:
+// a transition table per rule and a loop that does one lookup per byte.
+//
+//     ./dfagen > dfa.c      (make does this, see the Makefile)
+//
+// The rules below must say what their namesakes in http.c say; the
+// differential test (test_dfa) runs both over the bench corpus and
+// fails when they disagree on any input.
+//
+// Copyright 2018, Guido Witmond <guido@witmond.nl>
+// Licensed under AGPL v3 or later. See LICENSE
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+//----------------------------------------
+// Regular expressions
+
+typedef enum { RE_EPS, RE_SET, RE_SEQ, RE_ALT, RE_STAR } re_kind_t;
+
+typedef struct re {
+  re_kind_t kind;
+  uint8_t set[32];           // RE_SET: a bit per byte
+  struct re *a, *b;
+} re_t;
+
+static re_t *re_new(re_kind_t kind, re_t *a, re_t *b) {
+  re_t *re = calloc(1, sizeof(re_t));
+  if (NULL == re) {
+    perror("dfagen");
+    exit(1);
+  }
+  re->kind = kind;
+  re->a = a;
+  re->b = b;
+  return re;
+}
+
+static re_t *eps(void) {
+  return re_new(RE_EPS, NULL, NULL);
+}
+
+// h_ch_range(lo, hi)
+static re_t *range(int lo, int hi) {
+  re_t *re = re_new(RE_SET, NULL, NULL);
+  for (int c = lo; c <= hi; c++) {
+    re->set[c / 8] |= 1 << (c % 8);
+  }
+  return re;
+}
+
+// h_in(chars)
+static re_t *in(const char *chars) {
+  re_t *re = re_new(RE_SET, NULL, NULL);
+  for (const uint8_t *c = (const uint8_t *)chars; *c; c++) {
+    re->set[*c / 8] |= 1 << (*c % 8);
+  }
+  return re;
+}
+
+// h_sequence(...), NULL terminated
+static re_t *seq(re_t *first, ...) {
+  va_list ap;
+  va_start(ap, first);
+  re_t *re = first;
+  for (re_t *next; NULL != (next = va_arg(ap, re_t *)); ) {
+    re = re_new(RE_SEQ, re, next);
+  }
+  va_end(ap);
+  return re;
+}
+
+// h_choice(...), NULL terminated
+static re_t *alt(re_t *first, ...) {
+  va_list ap;
+  va_start(ap, first);
+  re_t *re = first;
+  for (re_t *next; NULL != (next = va_arg(ap, re_t *)); ) {
+    re = re_new(RE_ALT, re, next);
+  }
+  va_end(ap);
+  return re;
+}
+
+// h_token(s)
+static re_t *lit(const char *s) {
+  re_t *re = eps();
+  for (; *s; s++) {
+    re = seq(re, range((uint8_t)*s, (uint8_t)*s), NULL);
+  }
+  return re;
+}
+
+static re_t *many(re_t *a)     { return re_new(RE_STAR, a, NULL); }
+static re_t *many1(re_t *a)    { return seq(a, many(a), NULL); }
+static re_t *optional(re_t *a) { return alt(a, eps(), NULL); }
+
+
+//----------------------------------------
+// The rules, as in http.c
+
+#define ALPHA_DIGIT "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789"
+
+static re_t *pchar(void) {
+  return alt(in(ALPHA_DIGIT "-._~" "!$&'()*+,;=" ":@"),
+	     seq(lit("%"), in("0123456789abcdefABCDEF"), in("0123456789abcdefABCDEF"), NULL),
+	     NULL);
+}
+
+typedef struct {
+  const char *name;
+  re_t *(*re)(void);
+} rule_t;
+
+static re_t *any_method(void)      { return alt(lit("GET"), lit("POST"), NULL); }
+static re_t *http_version(void)    { return lit("HTTP/1.1"); }
+static re_t *any_status_code(void) { return seq(range('1', '5'), range('0', '9'), range('0', '9'), NULL); }
+static re_t *any_header_name(void) { return many1(in(ALPHA_DIGIT "-_.")); }
+static re_t *lws(void)             { return seq(optional(lit("\r\n")), many1(in(" \t")), NULL); }
+static re_t *reason_text(void)     { return alt(range(32, 126), in("\t"), NULL); }
+static re_t *post_url_chars(void)  { return many1(in(ALPHA_DIGIT "/.")); }
+static re_t *request_uri(void) {
+  return seq(many1(seq(lit("/"), many(pchar()), NULL)),
+	     many(seq(lit("?"), many(alt(pchar(), in("/?"), NULL)), NULL)),
+	     NULL);
+}
+
+static const rule_t rules[] = {
+  { "any_method",      any_method },
+  { "http_version",    http_version },
+  { "any_status_code", any_status_code },
+  { "any_header_name", any_header_name },
+  { "lws",             lws },
+  { "reason_text",     reason_text },
+  { "post_url_chars",  post_url_chars },
+  { "request_uri",     request_uri },
+};
+
+
+//----------------------------------------
+// NFA: every state has a byte set to one state, and/or up to two
+// empty moves
+
+#define MAX_NFA 1024
+#define SET_WORDS (MAX_NFA / 64)
+
+typedef struct {
+  uint8_t set[32];
+  int has_set;
+  int out;                   // on a byte in set
+  int eps[2];                // -1 for none
+} nstate_t;
+
+static nstate_t nfa[MAX_NFA];
+static int nfa_len;
+
+static int nstate(void) {
+  if (nfa_len == MAX_NFA) {
+    fprintf(stderr, "dfagen: NFA too large, raise MAX_NFA\n");
+    exit(1);
+  }
+  memset(&nfa[nfa_len], 0, sizeof(nstate_t));
+  nfa[nfa_len].out = nfa[nfa_len].eps[0] = nfa[nfa_len].eps[1] = -1;
+  return nfa_len++;
+}
+
+static void add_eps(int from, int to) {
+  nfa[from].eps[nfa[from].eps[0] < 0 ? 0 : 1] = to;
+}
+
+// Build re from start; returns the state it ends in
+static int build(const re_t *re, int start) {
+  switch (re->kind) {
+  case RE_EPS:
+    return start;
+  case RE_SET: {
+    int end = nstate();
+    memcpy(nfa[start].set, re->set, 32);
+    nfa[start].has_set = 1;
+    nfa[start].out = end;
+    return end;
+  }
+  case RE_SEQ:
+    return build(re->b, build(re->a, start));
+  case RE_ALT: {
+    int a = nstate(), b = nstate(), end = nstate();
+    add_eps(start, a);
+    add_eps(start, b);
+    add_eps(build(re->a, a), end);
+    add_eps(build(re->b, b), end);
+    return end;
+  }
+  case RE_STAR: {
+    int body = nstate(), end = nstate();
+    add_eps(start, body);
+    add_eps(start, end);
+    int body_end = build(re->a, body);
+    add_eps(body_end, body);
+    add_eps(body_end, end);
+    return end;
+  }
+  }
+  return start;
+}
+
+
+//----------------------------------------
+// DFA: a state per set of NFA states
+
+typedef struct {
+  uint64_t nstates[SET_WORDS];
+  int next[256];
+  int accept;
+} dstate_t;
+
+static dstate_t *dfa;
+static int dfa_len, dfa_cap;
+
+static void closure(uint64_t *set) {
+  int changed = 1;
+  while (changed) {
+    changed = 0;
+    for (int s = 0; s < nfa_len; s++) {
+      if (!(set[s / 64] >> (s % 64) & 1)) {
+	continue;
+      }
+      for (int i = 0; i < 2; i++) {
+	int t = nfa[s].eps[i];
+	if (t >= 0 && !(set[t / 64] >> (t % 64) & 1)) {
+	  set[t / 64] |= (uint64_t)1 << (t % 64);
+	  changed = 1;
+	}
+      }
+    }
+  }
+}
+
+static int is_empty(const uint64_t *set) {
+  for (int i = 0; i < SET_WORDS; i++) {
+    if (set[i]) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+// The DFA state for set, new or not
+static int dstate(const uint64_t *set, int accept_state) {
+  for (int i = 1; i < dfa_len; i++) {
+    if (0 == memcmp(dfa[i].nstates, set, sizeof(dfa[i].nstates))) {
+      return i;
+    }
+  }
+  if (dfa_len == dfa_cap) {
+    dfa_cap *= 2;
+    dfa = realloc(dfa, dfa_cap * sizeof(dstate_t));
+    if (NULL == dfa) {
+      perror("dfagen");
+      exit(1);
+    }
+  }
+  memset(&dfa[dfa_len], 0, sizeof(dstate_t));
+  memcpy(dfa[dfa_len].nstates, set, sizeof(dfa[dfa_len].nstates));
+  dfa[dfa_len].accept = set[accept_state / 64] >> (accept_state % 64) & 1;
+  return dfa_len++;
+}
+
+/* State 0 is dead: no way to a match from there. State 1 is the start.
+ */
+static void subset_construction(int start, int accept) {
+  dfa_cap = 64;
+  dfa = calloc(dfa_cap, sizeof(dstate_t));
+  dfa_len = 1;
+  uint64_t set[SET_WORDS] = { 0 };
+  set[start / 64] |= (uint64_t)1 << (start % 64);
+  closure(set);
+  dstate(set, accept);
+
+  for (int d = 1; d < dfa_len; d++) {
+    for (int c = 0; c < 256; c++) {
+      uint64_t next[SET_WORDS] = { 0 };
+      for (int s = 0; s < nfa_len; s++) {
+	if ((dfa[d].nstates[s / 64] >> (s % 64) & 1) && nfa[s].has_set && (nfa[s].set[c / 8] >> (c % 8) & 1)) {
+	  next[nfa[s].out / 64] |= (uint64_t)1 << (nfa[s].out % 64);
+	}
+      }
+      closure(next);
+      dfa[d].next[c] = is_empty(next) ? 0 : dstate(next, accept);
+    }
+  }
+}
+
+
+//----------------------------------------
+// C
+
+static void emit(const char *name) {
+  const char *type = dfa_len <= 256 ? "uint8_t" : "uint16_t";
+  printf("\n// %s: %d states\n", name, dfa_len);
+  printf("static const %s %s_next[%d][256] = {\n", type, name, dfa_len);
+  for (int d = 0; d < dfa_len; d++) {
+    printf("  {");
+    for (int c = 0; c < 256; c++) {
+      printf("%s%d", c ? "," : "", d ? dfa[d].next[c] : 0);
+    }
+    printf("},\n");
+  }
+  printf("};\n");
+  printf("static const uint8_t %s_accept[%d] = {", name, dfa_len);
+  for (int d = 0; d < dfa_len; d++) {
+    printf("%s%d", d ? "," : "", dfa[d].accept);
+  }
+  printf("};\n\n");
+  printf("int dfa_%s(const uint8_t *input, size_t length, size_t *match_len) {\n", name);
+  printf("  unsigned state = 1;\n");
+  printf("  int found = %s_accept[1];\n", name);
+  printf("  *match_len = 0;\n");
+  printf("  for (size_t i = 0; i < length; i++) {\n");
+  printf("    state = %s_next[state][input[i]];\n", name);
+  printf("    if (0 == state) {\n");
+  printf("      break;\n");
+  printf("    }\n");
+  printf("    if (%s_accept[state]) {\n", name);
+  printf("      found = 1;\n");
+  printf("      *match_len = i + 1;\n");
+  printf("    }\n");
+  printf("  }\n");
+  printf("  return found;\n");
+  printf("}\n");
+}
+
+int main(void) {
+  printf("// Generated by tools/dfagen.c from the regular rules of http.c.\n");
+  printf("// Do not edit; change the rules there and in dfagen.c.\n\n");
+  printf("#include <stddef.h>\n");
+  printf("#include <stdint.h>\n");
+  printf("#include \"dfa.h\"\n");
+  for (size_t i = 0; i < sizeof(rules) / sizeof(rules[0]); i++) {
+    nfa_len = 0;
+    int start = nstate();
+    int accept = build(rules[i].re(), start);
+    subset_construction(start, accept);
+    emit(rules[i].name);
+    free(dfa);
+  }
+  return 0;
+}